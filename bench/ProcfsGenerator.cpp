@@ -0,0 +1,324 @@
+#include "ProcfsGenerator.h"
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+// Uniform value in [0, bound)
+static unsigned randomBelow(std::mt19937& rng, unsigned bound) {
+  return static_cast<unsigned>(rng() % bound);
+}
+
+static bool writeFile(const std::string& path, const std::string& contents) {
+  std::ofstream file(path, std::ios::binary);
+
+  file << contents;
+  return static_cast<bool>(file);
+}
+
+static std::string statFile(unsigned numCores, std::mt19937& rng) {
+  std::string text;
+  char line[256];
+  unsigned long sum[7] = {};
+  std::string cores;
+
+  for (unsigned i = 0; i < numCores; i++) {
+    unsigned long v[7];
+
+    for (auto& x : v) x = randomBelow(rng, 10000000);
+    for (int j = 0; j < 7; j++) sum[j] += v[j];
+    snprintf(line, sizeof(line), "cpu%u %lu %lu %lu %lu %lu %lu %lu 0 0 0\n",
+             i, v[0], v[1], v[2], v[3], v[4], v[5], v[6]);
+    cores += line;
+  }
+
+  snprintf(line, sizeof(line), "cpu  %lu %lu %lu %lu %lu %lu %lu 0 0 0\n",
+           sum[0], sum[1], sum[2], sum[3], sum[4], sum[5], sum[6]);
+  text = line + cores;
+  text +=
+      "intr 1234567 0 9 0 0 0 0 0 0 1 0 0 0 156 0 0 0\n"
+      "ctxt 987654321\n"
+      "btime 1700000000\n"
+      "processes 123456\n"
+      "procs_running 2\n"
+      "procs_blocked 0\n"
+      "softirq 7654321 0 123 4 5678 90 0 12 3456 0 789\n";
+
+  return text;
+}
+
+static std::string meminfoFile() {
+  static const char* const labels[] = {
+      "MemTotal",       "MemFree",       "MemAvailable",   "Buffers",
+      "Cached",         "SwapCached",    "Active",         "Inactive",
+      "Active(anon)",   "Inactive(anon)", "Active(file)",  "Inactive(file)",
+      "Unevictable",    "Mlocked",       "SwapTotal",      "SwapFree",
+      "Zswap",          "Zswapped",      "Dirty",          "Writeback",
+      "AnonPages",      "Mapped",        "Shmem",          "KReclaimable",
+      "Slab",           "SReclaimable",  "SUnreclaim",     "KernelStack",
+      "PageTables",     "SecPageTables", "NFS_Unstable",   "Bounce",
+      "WritebackTmp",   "CommitLimit",   "Committed_AS",   "VmallocTotal",
+      "VmallocUsed",    "VmallocChunk",  "Percpu",         "HardwareCorrupted",
+      "AnonHugePages",  "ShmemHugePages", "ShmemPmdMapped", "FileHugePages",
+      "FilePmdMapped",  "Hugetlb",       "DirectMap4k",    "DirectMap2M",
+  };
+  unsigned long values[] = {65843200, 20123456, 50123456, 1234567, 25123456};
+  std::string text;
+  char line[128];
+
+  for (size_t i = 0; i < sizeof(labels) / sizeof(labels[0]); i++) {
+    unsigned long value =
+        i < sizeof(values) / sizeof(values[0]) ? values[i] : 123456 + i;
+    snprintf(line, sizeof(line), "%-16s%8lu kB\n",
+             (std::string(labels[i]) + ":").c_str(), value);
+    text += line;
+  }
+
+  return text;
+}
+
+// Devices of the fake diskstats, of which only the disks are physical
+static const char* const diskNames[] = {"loop0", "nvme0n1", "nvme0n1p1",
+                                        "nvme0n1p2", "sda", "sda1", "dm-0"};
+static const char* const physicalDiskNames[] = {"nvme0n1", "sda"};
+
+static std::string diskstatsFile(std::mt19937& rng) {
+  std::string text;
+  char line[256];
+
+  for (const char* name : diskNames) {
+    snprintf(line, sizeof(line),
+             "%4u %7u %s %u %u %u %u %u %u %u %u 0 %u %u 0 0 0 0 %u %u\n",
+             259u, randomBelow(rng, 16), name, randomBelow(rng, 1000000),
+             randomBelow(rng, 1000), randomBelow(rng, 100000000),
+             randomBelow(rng, 1000000), randomBelow(rng, 1000000),
+             randomBelow(rng, 1000), randomBelow(rng, 100000000),
+             randomBelow(rng, 1000000), randomBelow(rng, 1000000),
+             randomBelow(rng, 1000000), randomBelow(rng, 100000),
+             randomBelow(rng, 100000));
+    text += line;
+  }
+
+  return text;
+}
+
+static std::string pidIo(std::mt19937& rng) {
+  char text[512];
+
+  snprintf(text, sizeof(text),
+           "rchar: %u\nwchar: %u\nsyscr: %u\nsyscw: %u\nread_bytes: %u\n"
+           "write_bytes: %u\ncancelled_write_bytes: 0\n",
+           randomBelow(rng, 1000000000), randomBelow(rng, 1000000000),
+           randomBelow(rng, 1000000), randomBelow(rng, 1000000),
+           randomBelow(rng, 100000000), randomBelow(rng, 100000000));
+
+  return text;
+}
+
+static std::string pidStat(unsigned pid, unsigned ppid, const char* name,
+                           std::mt19937& rng) {
+  char line[512];
+
+  snprintf(line, sizeof(line),
+           "%u (%s) S %u %u %u 0 -1 4194560 %u 0 0 0 %u %u 0 0 20 0 %u 0 "
+           "%u %u %u 18446744073709551615 1 1 0 0 0 0 0 0 0 0 0 0 17 %u 0 "
+           "0 0 0 0 0 0 0 0 0 0 0 0\n",
+           pid, name, ppid, pid, pid, randomBelow(rng, 100000),
+           randomBelow(rng, 100000), randomBelow(rng, 100000),
+           1 + randomBelow(rng, 32), randomBelow(rng, 1000000),
+           randomBelow(rng, 1000000000), randomBelow(rng, 100000),
+           randomBelow(rng, 64));
+
+  return line;
+}
+
+static std::string pidStatus(unsigned pid, unsigned ppid, const char* name,
+                             std::mt19937& rng) {
+  char text[2048];
+
+  snprintf(text, sizeof(text),
+           "Name:\t%s\nUmask:\t0022\nState:\tS (sleeping)\nTgid:\t%u\n"
+           "Ngid:\t0\nPid:\t%u\nPPid:\t%u\nTracerPid:\t0\n"
+           "Uid:\t0\t0\t0\t0\nGid:\t0\t0\t0\t0\nFDSize:\t64\nGroups:\t \n"
+           "NStgid:\t%u\nNSpid:\t%u\nNSpgid:\t%u\nNSsid:\t%u\n"
+           "Kthread:\t0\nVmPeak:\t  %u kB\nVmSize:\t  %u kB\n"
+           "VmLck:\t       0 kB\nVmPin:\t       0 kB\nVmHWM:\t    %u kB\n"
+           "VmRSS:\t    %u kB\nRssAnon:\t    1234 kB\nRssFile:\t    2345 kB\n"
+           "RssShmem:\t       0 kB\nVmData:\t    4567 kB\nVmStk:\t     132 kB\n"
+           "VmExe:\t     840 kB\nVmLib:\t    1812 kB\nVmPTE:\t      60 kB\n"
+           "VmSwap:\t       %u kB\nHugetlbPages:\t       0 kB\n"
+           "CoreDumping:\t0\nTHP_enabled:\t1\nuntag_mask:\t0xffffffffffffffff\n"
+           "Threads:\t%u\nSigQ:\t0/254334\nSigPnd:\t0000000000000000\n"
+           "ShdPnd:\t0000000000000000\nSigBlk:\t0000000000000000\n"
+           "SigIgn:\t0000000000001000\nSigCgt:\t0000000180004002\n"
+           "CapInh:\t0000000000000000\nCapPrm:\t000001ffffffffff\n"
+           "CapEff:\t000001ffffffffff\nCapBnd:\t000001ffffffffff\n"
+           "CapAmb:\t0000000000000000\nNoNewPrivs:\t0\nSeccomp:\t0\n"
+           "Seccomp_filters:\t0\nSpeculation_Store_Bypass:\tthread vulnerable\n"
+           "SpeculationIndirectBranch:\tconditional enabled\n"
+           "Cpus_allowed:\tff\nCpus_allowed_list:\t0-7\n"
+           "Mems_allowed:\t00000001\nMems_allowed_list:\t0\n"
+           "voluntary_ctxt_switches:\t%u\nnonvoluntary_ctxt_switches:\t%u\n",
+           name, pid, pid, ppid, pid, pid, pid, pid,
+           randomBelow(rng, 1000000), randomBelow(rng, 1000000),
+           randomBelow(rng, 100000), randomBelow(rng, 100000),
+           randomBelow(rng, 1000), 1 + randomBelow(rng, 32),
+           randomBelow(rng, 100000), randomBelow(rng, 1000));
+
+  return text;
+}
+
+static std::string pidSmapsRollup(std::mt19937& rng) {
+  unsigned privateClean = randomBelow(rng, 10000);
+  unsigned privateDirty = randomBelow(rng, 50000);
+  unsigned shared = randomBelow(rng, 20000);
+  char text[1024];
+
+  snprintf(text, sizeof(text),
+           "55d0c0a00000-7ffd5e9fe000 ---p 00000000 00:00 0"
+           "                          [rollup]\n"
+           "Rss:            %8u kB\nPss:            %8u kB\n"
+           "Pss_Dirty:      %8u kB\nPss_Anon:       %8u kB\n"
+           "Pss_File:       %8u kB\nPss_Shmem:             0 kB\n"
+           "Shared_Clean:   %8u kB\nShared_Dirty:          0 kB\n"
+           "Private_Clean:  %8u kB\nPrivate_Dirty:  %8u kB\n"
+           "Referenced:     %8u kB\nAnonymous:      %8u kB\n"
+           "KSM:                   0 kB\nLazyFree:              0 kB\n"
+           "AnonHugePages:         0 kB\nShmemPmdMapped:        0 kB\n"
+           "FilePmdMapped:         0 kB\nShared_Hugetlb:        0 kB\n"
+           "Private_Hugetlb:       0 kB\nSwap:                  0 kB\n"
+           "SwapPss:               0 kB\nLocked:                0 kB\n",
+           privateClean + privateDirty + shared,
+           privateClean + privateDirty + shared / 4, privateDirty,
+           privateDirty, privateClean + shared / 4, shared, privateClean,
+           privateDirty, privateClean + privateDirty + shared, privateDirty);
+
+  return text;
+}
+
+bool generateProcfs(const std::string& root, unsigned numProcs,
+                    unsigned numCores) {
+  static const char* const names[] = {
+      "systemd", "sshd", "bash", "nginx: worker", "(sd-pam)", "java",
+      "python3", "kworker/3:1H",
+  };
+  // Fixed seed so that runs are comparable
+  std::mt19937 rng(42);
+
+  std::filesystem::create_directories(root);
+  if (!writeFile(root + "/stat", statFile(numCores, rng)) ||
+      !writeFile(root + "/meminfo", meminfoFile()) ||
+      !writeFile(root + "/diskstats", diskstatsFile(rng))) {
+    return false;
+  }
+
+  for (unsigned i = 0; i < numProcs; i++) {
+    unsigned pid = i + 1;
+    unsigned ppid = i == 0 ? 0 : 1 + randomBelow(rng, i);
+    const char* name = names[i % (sizeof(names) / sizeof(names[0]))];
+    std::string dir = root + "/" + std::to_string(pid);
+
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) return false;
+    if (!writeFile(dir + "/stat", pidStat(pid, ppid, name, rng)) ||
+        !writeFile(dir + "/status", pidStatus(pid, ppid, name, rng)) ||
+        !writeFile(dir + "/comm", std::string(name) + "\n") ||
+        !writeFile(dir + "/smaps_rollup", pidSmapsRollup(rng)) ||
+        !writeFile(dir + "/io", pidIo(rng))) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool writeCgroup(const std::string& dir, std::mt19937& rng) {
+  char text[1024];
+  unsigned long anon = randomBelow(rng, 1000000) * 4096ul;
+  unsigned long file = randomBelow(rng, 1000000) * 4096ul;
+
+  if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) return false;
+
+  snprintf(text, sizeof(text),
+           "usage_usec %u\nuser_usec %u\nsystem_usec %u\nnr_periods 0\n"
+           "nr_throttled 0\nthrottled_usec 0\nnr_bursts 0\n"
+           "burst_usec 0\n",
+           randomBelow(rng, 1000000000), randomBelow(rng, 500000000),
+           randomBelow(rng, 500000000));
+  if (!writeFile(dir + "/cpu.stat", text)) return false;
+  if (!writeFile(dir + "/memory.current", std::to_string(anon + file) + "\n")) {
+    return false;
+  }
+
+  snprintf(text, sizeof(text),
+           "anon %lu\nfile %lu\nkernel 1234944\nkernel_stack 98304\n"
+           "pagetables 245760\nsec_pagetables 0\npercpu 2880\n"
+           "sock 0\nvmalloc 0\nshmem 0\nfile_mapped 1327104\n"
+           "file_dirty 0\nfile_writeback 0\nswapcached 0\n"
+           "anon_thp 0\nfile_thp 0\nshmem_thp 0\ninactive_anon %lu\n"
+           "active_anon 0\ninactive_file %lu\nactive_file 0\n"
+           "unevictable 0\nslab_reclaimable 123456\n"
+           "slab_unreclaimable 234567\nslab 358023\n",
+           anon, file, anon, file);
+  if (!writeFile(dir + "/memory.stat", text)) return false;
+
+  snprintf(text, sizeof(text),
+           "259:0 rbytes=%u wbytes=%u rios=%u wios=%u dbytes=0 dios=0\n"
+           "8:0 rbytes=%u wbytes=%u rios=%u wios=%u dbytes=0 dios=0\n",
+           randomBelow(rng, 1000000000), randomBelow(rng, 1000000000),
+           randomBelow(rng, 100000), randomBelow(rng, 100000),
+           randomBelow(rng, 1000000000), randomBelow(rng, 1000000000),
+           randomBelow(rng, 100000), randomBelow(rng, 100000));
+  if (!writeFile(dir + "/io.stat", text)) return false;
+
+  return writeFile(dir + "/cgroup.procs",
+                   std::to_string(1 + randomBelow(rng, 30000)) + "\n");
+}
+
+bool generateCgroupfs(const std::string& root, unsigned numCgroups) {
+  static const char* const slices[] = {"system.slice", "user.slice",
+                                       "kubepods.slice"};
+  std::mt19937 rng(42);
+
+  std::filesystem::create_directories(root);
+  if (!writeCgroup(root, rng)) return false;
+  for (const char* slice : slices) {
+    if (!writeCgroup(root + "/" + slice, rng)) return false;
+  }
+
+  for (unsigned i = 0; i < numCgroups; i++) {
+    const char* slice = slices[i % (sizeof(slices) / sizeof(slices[0]))];
+    std::string dir =
+        root + "/" + slice + "/container-" + std::to_string(i) + ".scope";
+
+    if (!writeCgroup(dir, rng)) return false;
+  }
+
+  return true;
+}
+
+bool generateSysfs(const std::string& root) {
+  std::error_code ec;
+
+  // Virtual devices are in /sys/block too, but without a device link
+  for (const char* name : {"loop0", "dm-0"}) {
+    std::filesystem::create_directories(root + "/block/" + name, ec);
+    if (ec) return false;
+  }
+  for (const char* name : physicalDiskNames) {
+    std::filesystem::create_directories(root + "/block/" + name + "/device",
+                                        ec);
+    if (ec) return false;
+  }
+
+  return true;
+}
+
+void removeProcfs(const std::string& root) {
+  std::error_code ec;
+
+  std::filesystem::remove_all(root, ec);
+}
@@ -0,0 +1,26 @@
+#ifndef PROCFS_GENERATOR_H
+#define PROCFS_GENERATOR_H
+
+#include <string>
+
+// Build a fake procfs tree under root with numProcs processes and numCores
+// cores: stat, meminfo and diskstats at the top, and stat, status, comm,
+// smaps_rollup and io for every PID. The files mimic the real format and size
+// closely enough for the collectors to parse them the same way.
+bool generateProcfs(const std::string& root, unsigned numProcs,
+                    unsigned numCores);
+
+// Build a fake cgroup v2 hierarchy under root with numCgroups leaf cgroups
+// spread over a few slices, each with cpu.stat, memory.current, memory.stat,
+// io.stat and cgroup.procs
+bool generateCgroupfs(const std::string& root, unsigned numCgroups);
+
+// Build a fake sysfs under root with the /sys/block entries of the devices in
+// the diskstats of generateProcfs()
+bool generateSysfs(const std::string& root);
+
+// Remove a tree made by generateProcfs(), generateCgroupfs() or
+// generateSysfs()
+void removeProcfs(const std::string& root);
+
+#endif /* PROCFS_GENERATOR_H */
@@ -0,0 +1,258 @@
+// Microbenchmarks for the collection and rendering hot paths, run against a
+// synthetic procfs tree and the live /proc. Reports wall time and heap
+// allocations per operation.
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cxxopts.hpp>
+#include <new>
+
+#include "CgroupTable.h"
+#include "Display.h"
+#include "ProcessTable.h"
+#include "ProcfsGenerator.h"
+#include "Renderer.h"
+#include "SharedSnapshot.h"
+#include "SystemInfo.h"
+
+static std::atomic<unsigned long> allocCount{0};
+
+void* operator new(size_t size) {
+  allocCount.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+template <typename Fn>
+static void runBench(const char* name, unsigned iterations, Fn&& fn) {
+  // Warm up so that persistent state (open files, buffers, maps) is built
+  fn();
+
+  unsigned long allocsBefore = allocCount.load(std::memory_order_relaxed);
+  auto start = std::chrono::steady_clock::now();
+
+  for (unsigned i = 0; i < iterations; i++) fn();
+
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  unsigned long allocs =
+      allocCount.load(std::memory_order_relaxed) - allocsBefore;
+  double nsPerOp =
+      std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+
+  std::printf("%-32s %14.0f ns/op %10.1f allocs/op\n", name, nsPerOp,
+              static_cast<double>(allocs) / iterations);
+}
+
+// Iterations that keep a benchmark of roughly this cost per op under ~1 s
+static unsigned iterationsFor(unsigned numProcs) {
+  return numProcs >= 10000 ? 5 : numProcs >= 1000 ? 50 : 200;
+}
+
+static void benchCollectors(const std::string& procRoot,
+                            const std::string& sysRoot, unsigned numProcs,
+                            unsigned maxThreads) {
+  SystemInfo sysInfo(procRoot, sysRoot);
+  ProcessTable procTable(0, 1, procRoot);
+  unsigned iterations = iterationsFor(numProcs);
+  char name[64];
+
+  runBench("getCpuUsage", 10000, [&] { sysInfo.getCpuUsage(); });
+  runBench("getMemoryUsage", 10000, [&] { sysInfo.getMemoryUsage(); });
+
+  std::vector<DiskUsage> disks;
+
+  runBench("getDiskUsage", 10000, [&] { sysInfo.getDiskUsage(disks); });
+  runBench("getProcesses (update)", iterations, [&] { procTable.update(); });
+
+  for (unsigned threads = 2; threads <= maxThreads; threads *= 2) {
+    ProcessTable parallelTable(0, threads, procRoot);
+
+    snprintf(name, sizeof(name), "getProcesses (update) x%u", threads);
+    runBench(name, iterations, [&] { parallelTable.update(); });
+  }
+
+  ProcessTable adaptiveTable(0, 1, procRoot);
+
+  // Once warmed up, only the displayed processes and those whose idle
+  // interval ran out are read. The synthetic counters never move, so this is
+  // the all-idle steady state.
+  adaptiveTable.enableAdaptiveSampling(0);
+  for (unsigned long i = 0; i < ProcessTable::maxIdleInterval; i++) {
+    adaptiveTable.update();
+    adaptiveTable.getTopProcesses(20);
+  }
+  runBench("getProcesses (update) adaptive", iterations, [&] {
+    adaptiveTable.update();
+    adaptiveTable.getTopProcesses(20);
+  });
+
+  ProcessTable fullTable(ProcessTable::FieldSwap | ProcessTable::FieldFullName,
+                         1, procRoot);
+
+  runBench("getProcesses (+status, comm)", iterations,
+           [&] { fullTable.update(); });
+
+  ProcessTable ioTable(ProcessTable::FieldIo, 1, procRoot);
+
+  // Sorting by I/O makes update() read /proc/<pid>/io for every process
+  ioTable.getTopProcesses(20, SortKey::Io);
+  runBench("getProcesses (+io, sort io)", iterations, [&] {
+    ioTable.update();
+    ioTable.getTopProcesses(20, SortKey::Io);
+  });
+  runBench("getTopProcesses(20)", 1000,
+           [&] { procTable.getTopProcesses(20); });
+
+  ProcessTable treeTable(0, 1, procRoot);
+
+  // Once built, the tree is only walked for processes whose values changed,
+  // which with the static synthetic counters is none of them
+  treeTable.enableTree(true);
+  treeTable.update();
+  runBench("getProcesses (update) tree", iterations,
+           [&] { treeTable.update(); });
+  runBench("ProcessTree build", iterations, [&] {
+    treeTable.enableTree(false);
+    treeTable.enableTree(true);
+  });
+  runBench("getProcessTree(20)", 1000,
+           [&] { treeTable.getProcessTree(20); });
+
+  ProcessTable pssTable(0, 1, procRoot);
+
+  // The first call reads every process, later ones only the top 20 as RSS
+  // does not change between update()s
+  pssTable.enablePss(std::chrono::seconds(10));
+  pssTable.update();
+  pssTable.getTopProcesses(20);
+  runBench("getTopProcesses(20) +pss", 1000,
+           [&] { pssTable.getTopProcesses(20); });
+
+  std::vector<ProcessInfo> top = procTable.getTopProcesses(20);
+  std::vector<ThreadInfo> threads;
+
+  // Counters only move between update()s, so after the first call this is
+  // the cost of the cached path
+  runBench("getThreads(20)", 1000,
+           [&] { procTable.getThreads(top, 20, threads); });
+}
+
+static void benchRendering(const std::string& procRoot) {
+  SystemInfo sysInfo(procRoot);
+  ProcessTable procTable(0, 1, procRoot);
+  int devNull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+  Renderer renderer(devNull);
+  DisplayOptions options;
+  Snapshot snapshots[2];
+
+  // Two different frames, so that every draw has lines to update
+  for (Snapshot& snapshot : snapshots) {
+    procTable.update();
+    snapshot.cpu = sysInfo.getCpuUsage();
+    snapshot.mem = sysInfo.getMemoryUsage();
+    snapshot.processCount = procTable.processCount();
+    snapshot.processes = procTable.getTopProcesses(50);
+  }
+  snapshots[1].cpu.totalUsage += 1;
+  snapshots[1].processes.front().cpuUsed += 1;
+
+  unsigned frame = 0;
+
+  runBench("drawSnapshot", 10000,
+           [&] { drawSnapshot(renderer, snapshots[frame++ % 2], options); });
+  close(devNull);
+
+  SnapshotPublisher publisher;
+  SnapshotViewer viewer;
+  Snapshot copy;
+  std::string name = "/mini-top-bench." + std::to_string(getpid());
+  std::string error;
+
+  if (!publisher.open(name, 0, std::chrono::milliseconds(1000), error) ||
+      !viewer.open(name, error)) {
+    std::fprintf(stderr, "Skipping shared snapshots: %s\n", error.c_str());
+    return;
+  }
+  runBench("SnapshotPublisher::write", 10000,
+           [&] { publisher.write(snapshots[frame++ % 2]); });
+  runBench("SnapshotViewer::read", 10000, [&] { viewer.read(copy); });
+}
+
+int main(int argc, char* argv[]) {
+  cxxopts::Options options("bench", "mini-top microbenchmarks");
+
+  options.add_options()
+      ("procs", "Processes in the synthetic procfs",
+       cxxopts::value<unsigned>()->default_value("10000"))
+      ("cores", "Cores in the synthetic procfs",
+       cxxopts::value<unsigned>()->default_value("64"))
+      ("cgroups", "Leaf cgroups in the synthetic cgroupfs",
+       cxxopts::value<unsigned>()->default_value("500"))
+      ("max-threads", "Largest --scan-threads value to measure",
+       cxxopts::value<unsigned>()->default_value("8"))
+      ("h,help", "Print help");
+
+  auto result = options.parse(argc, argv);
+
+  if (result.count("help")) {
+    std::printf("%s\n", options.help().c_str());
+    return 0;
+  }
+
+  unsigned numProcs = result["procs"].as<unsigned>();
+  unsigned numCores = result["cores"].as<unsigned>();
+  unsigned maxThreads = result["max-threads"].as<unsigned>();
+  unsigned numCgroups = result["cgroups"].as<unsigned>();
+  char root[] = "/tmp/mini-top-procfs.XXXXXX";
+  char sysRoot[] = "/tmp/mini-top-sysfs.XXXXXX";
+
+  if (!mkdtemp(root) || !generateProcfs(root, numProcs, numCores) ||
+      !mkdtemp(sysRoot) || !generateSysfs(sysRoot)) {
+    std::fprintf(stderr, "Cannot generate the synthetic procfs\n");
+    return 1;
+  }
+
+  std::printf("== synthetic procfs: %u processes, %u cores\n", numProcs,
+              numCores);
+  benchCollectors(root, sysRoot, numProcs, maxThreads);
+  benchRendering(root);
+  removeProcfs(root);
+  removeProcfs(sysRoot);
+
+  char cgroupRoot[] = "/tmp/mini-top-cgroupfs.XXXXXX";
+
+  if (!mkdtemp(cgroupRoot) || !generateCgroupfs(cgroupRoot, numCgroups)) {
+    std::fprintf(stderr, "Cannot generate the synthetic cgroupfs\n");
+    return 1;
+  }
+
+  CgroupTable cgroupTable(cgroupRoot);
+
+  std::printf("== synthetic cgroupfs: %u cgroups\n", numCgroups);
+  runBench("CgroupTable::update", iterationsFor(numCgroups),
+           [&] { cgroupTable.update(); });
+  removeProcfs(cgroupRoot);
+
+  std::printf("== /proc\n");
+  benchCollectors("/proc", "/sys", 100, maxThreads);
+
+  ProcessTable eventTable(0, 1, "/proc");
+  std::string error;
+
+  if (eventTable.enableProcEvents(error)) {
+    runBench("getProcesses (update) events", 100,
+             [&] { eventTable.update(); });
+  } else {
+    std::printf("proc events unavailable: %s\n", error.c_str());
+  }
+
+  return 0;
+}
@@ -0,0 +1,55 @@
+#ifndef BATCH_WRITER_H
+#define BATCH_WRITER_H
+
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+
+#include "Collector.h"
+
+// Output formats of batch mode
+enum class BatchFormat {
+  // One row per system total, core, disk, cgroup, process, expanded thread
+  // and short-lived process, with a leading type column
+  Csv,
+  // One JSON object per tick
+  JsonLines,
+};
+
+// Serializes snapshots for pipelines. Each tick is formatted into a reused
+// buffer with to_chars and written out with a single write(2).
+class BatchWriter {
+ public:
+  // At most maxProcesses rows of each snapshot are written. With selfStats
+  // mini-top's own overhead is written as well, with pss per-process PSS
+  // and USS, with io per-process I/O rates and per-disk activity, with tree
+  // the parent, tree depth and subtree sums of processes in tree order.
+  BatchWriter(int fd, BatchFormat format, size_t maxProcesses = SIZE_MAX,
+              bool selfStats = false, bool pss = false, bool io = false,
+              bool tree = false);
+
+  void write(const Snapshot& snapshot);
+
+ private:
+  int fd;
+  BatchFormat format;
+  size_t maxProcesses;
+  bool selfStats;
+  bool pss;
+  bool io;
+  bool tree;
+  // Short-lived process columns, set from the first snapshot
+  bool events = false;
+  bool headerWritten = false;
+  std::string buffer;
+
+  void writeCsv(const Snapshot& snapshot);
+  void writeJson(const Snapshot& snapshot);
+  void appendNumber(unsigned long value);
+  void appendNumber(double value);
+  void appendCsvString(std::string_view str);
+  void appendJsonString(std::string_view str);
+};
+
+#endif /* BATCH_WRITER_H */
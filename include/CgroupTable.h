@@ -0,0 +1,79 @@
+#ifndef CGROUP_TABLE_H
+#define CGROUP_TABLE_H
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "ProcessStore.h"
+
+// Structure describing one cgroup
+struct CgroupInfo {
+  // Path below the hierarchy root, "/" for the root itself
+  std::string path;
+  // CPU used by the cgroup in percent of one core, from cpu.stat
+  double cpuUsed;
+  // memory.current, and its anonymous and page cache parts from memory.stat
+  unsigned long memCurrentKB;
+  unsigned long memAnonKB;
+  unsigned long memFileKB;
+  // Bytes per second read and written, summed over the devices in io.stat
+  double readBytesPerSec;
+  double writeBytesPerSec;
+};
+
+// Per-cgroup usage from a cgroup v2 hierarchy. Every cgroup costs the same
+// four reads (cpu.stat, memory.current, memory.stat, io.stat) however many
+// processes it holds.
+class CgroupTable {
+ public:
+  // root is where the cgroup v2 hierarchy is mounted
+  explicit CgroupTable(const std::string& root = "/sys/fs/cgroup");
+  // Walk the hierarchy and re-read every cgroup. Rates are measured since the
+  // previous call; cgroups seen for the first time report zero.
+  void update();
+  // Number of cgroups seen by the last update()
+  size_t cgroupCount() const { return cgroups.size(); }
+  // The top n leaf cgroups of the last update() ordered by key. SortKey::Pid
+  // orders by path. Parents are left out: their usage is that of their
+  // descendants, and the root has no memory.current at all.
+  std::vector<CgroupInfo> getTopCgroups(size_t n, SortKey key = SortKey::Cpu);
+  // Replace pids with the members of the cgroup at path (as in
+  // CgroupInfo::path), from its cgroup.procs. Returns false if it is gone.
+  bool readProcs(const std::string& path, std::vector<int>& pids);
+  // path in the form of CgroupInfo::path: with a leading slash and without
+  // a trailing one, e.g. "system.slice/" gives "/system.slice"
+  static std::string normalizePath(std::string_view path);
+
+ private:
+  std::string root;
+  // Cgroups of the last update() in walk order
+  std::vector<CgroupInfo> cgroups;
+  // Whether each of cgroups has no child cgroup
+  std::vector<char> leaves;
+  size_t cgroupsRead = 0;
+
+  // Counters of a cgroup as of its last read, the base of the next rates
+  struct Counters {
+    unsigned long usageUsec = 0;
+    unsigned long readBytes = 0;
+    unsigned long writeBytes = 0;
+    std::chrono::steady_clock::time_point readAt;
+    unsigned long seenUpdate = 0;
+  };
+  std::unordered_map<std::string, Counters> counters;
+  unsigned long updates = 0;
+  // Reused by update()
+  std::string dirPath;
+  std::vector<char> readBuffer;
+  std::vector<size_t> topRows;
+
+  // Read the cgroup at dirPath and descend into its children
+  void walk(size_t rootLength);
+  void readCgroup(std::string_view path,
+                  std::chrono::steady_clock::time_point now);
+};
+
+#endif /* CGROUP_TABLE_H */
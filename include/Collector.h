@@ -0,0 +1,154 @@
+#ifndef COLLECTOR_H
+#define COLLECTOR_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "CgroupTable.h"
+#include "ProcessTable.h"
+#include "SelfStats.h"
+#include "SystemInfo.h"
+#include "WorkerPool.h"
+
+// Everything the display needs from one tick
+struct Snapshot {
+  // Sequence number of the tick, starting at 1
+  unsigned long tick = 0;
+  // Wall-clock time the tick was scheduled for
+  std::chrono::system_clock::time_point timestamp;
+  CpuUsage cpu;
+  MemoryUsage mem;
+  // Whole disks, empty unless disk stats are enabled
+  std::vector<DiskUsage> disks;
+  // Number of processes on the system
+  size_t processCount = 0;
+  // Processes started and exited since the previous tick
+  ProcessEvents events;
+  // Top processes in display order; in cgroup mode the members of the
+  // expanded cgroup only
+  std::vector<ProcessInfo> processes;
+  // Set when processes are in tree order, with depths and subtree sums
+  bool tree = false;
+  // Number of cgroups and the top ones in display order, cgroup mode only
+  size_t cgroupCount = 0;
+  std::vector<CgroupInfo> cgroups;
+  // Path of the cgroup whose processes are listed, empty if none
+  std::string expandedCgroup;
+  // Threads of the first expanded processes, grouped by process in display
+  // order; empty unless thread expansion is on
+  std::vector<ThreadInfo> threads;
+  // Ticks skipped so far because collection overran the next deadline
+  unsigned long missedDeadlines = 0;
+  // Time spent collecting this tick
+  std::chrono::nanoseconds collectTime{0};
+  // mini-top's own overhead, filled only with self stats enabled
+  SelfSample self;
+};
+
+// Samples the system on fixed deadlines from long-lived threads and publishes
+// each tick as a Snapshot that the display can read without blocking.
+class Collector {
+ public:
+  Collector(SystemInfo& sysInfo, ProcessTable& procTable,
+            std::chrono::milliseconds interval, size_t procNum,
+            SortKey sortKey);
+  ~Collector();
+  Collector(const Collector&) = delete;
+  Collector& operator=(const Collector&) = delete;
+
+  // Sample mini-top's own overhead into every snapshot
+  void enableSelfStats() { selfStats = true; }
+  // Sample per-disk activity into every snapshot
+  void enableDiskStats() { diskStats = true; }
+  // Collect per-cgroup usage from cgroupTable instead of reading every
+  // process; only the members of the expanded cgroup are read
+  void enableCgroups(CgroupTable& table) { cgroupTable = &table; }
+  // List the processes of the cgroup at path (as in CgroupInfo::path) from
+  // the next tick on, empty for none. May be called from any thread.
+  void expandCgroup(const std::string& path);
+  // Expand the first n processes into their threads on every tick from now
+  // on, 0 to stop. May be called from any thread.
+  void expandThreads(size_t n) {
+    threadProcs.store(n, std::memory_order_relaxed);
+  }
+  // List the processes as a tree with subtree sums from the next tick on, or
+  // go back to a flat list. May be called from any thread.
+  void enableTree(bool enable) {
+    treeOrder.store(enable, std::memory_order_relaxed);
+  }
+  // Call consumer with every tick on the sampling thread, before the tick is
+  // published. Unlike latest(), it sees every tick; a slow consumer delays
+  // the next one, which then counts as missed. Add consumers before start().
+  void addConsumer(std::function<void(const Snapshot&)> consumer) {
+    consumers.push_back(std::move(consumer));
+  }
+  // Start sampling; the first tick is collected immediately
+  void start();
+  // Stop sampling and join the threads
+  void stop();
+  // Wait up to timeout for a tick newer than lastTick to be published.
+  // Returns the number of the latest published tick.
+  unsigned long waitForTick(unsigned long lastTick,
+                            std::chrono::milliseconds timeout);
+  // The most recently published snapshot. It stays valid and unchanged until
+  // the next call to latest() from the same (single) reader thread.
+  const Snapshot& latest();
+
+ private:
+  SystemInfo& sysInfo;
+  ProcessTable& procTable;
+  std::chrono::milliseconds interval;
+  size_t procNum;
+  SortKey sortKey;
+  bool selfStats = false;
+  bool diskStats = false;
+  std::atomic<size_t> threadProcs{0};
+  std::atomic<bool> treeOrder{false};
+  CgroupTable* cgroupTable = nullptr;
+  // Guards expandedCgroup, which the reader thread sets
+  std::mutex cgroupMutex;
+  std::string expandedCgroup;
+  std::vector<std::function<void(const Snapshot&)>> consumers;
+  // Reused for the members of the expanded cgroup
+  std::vector<int> cgroupPids;
+
+  // CPU, memory and process collection run side by side on this pool, the
+  // scheduler thread being one of its workers
+  WorkerPool collectPool{3};
+  std::thread scheduler;
+
+  // Triple buffer: the scheduler fills slots[back], then swaps it with the
+  // shared middle slot; the reader swaps the middle slot with slots[front]
+  // when it holds a fresh snapshot. Neither side ever waits on the other.
+  std::array<Snapshot, 3> slots;
+  static constexpr unsigned freshBit = 4;
+  std::atomic<unsigned> middle{1};
+  unsigned back = 0;
+  unsigned front = 2;
+  std::atomic<unsigned long> publishedTick{0};
+  // Wakes waitForTick(); only the waiters and the notification use it, never
+  // the snapshot hand-off itself
+  std::mutex tickMutex;
+  std::condition_variable tickCv;
+
+  std::mutex stopMutex;
+  std::condition_variable stopCv;
+  bool stopping = false;
+
+  void run();
+  void collect(Snapshot& snapshot);
+  void collectCgroups(Snapshot& snapshot);
+  // The displayed processes of the last update, flat or in tree order
+  std::vector<ProcessInfo> topProcesses(bool tree);
+  void publish();
+};
+
+#endif /* COLLECTOR_H */
@@ -0,0 +1,35 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <stdint.h>
+
+#include <string>
+
+#include "Collector.h"
+#include "Renderer.h"
+
+// What to show besides the default columns
+struct DisplayOptions {
+  // Per-process swap column
+  bool showSwap = false;
+  // Per-process PSS and USS columns
+  bool showPss = false;
+  // Per-process I/O rate columns
+  bool showIo = false;
+  // Cgroup table above the process table
+  bool showCgroups = false;
+  // Cgroup row marked as selected, by path
+  std::string selectedCgroup;
+  // Footer with mini-top's own overhead
+  bool showSelfStats = false;
+  // Upper limit on process rows, on top of the window height
+  size_t maxProcesses = SIZE_MAX;
+  // Shown above everything else when not empty (e.g. replay position)
+  std::string statusLine;
+};
+
+// Draw a snapshot as one frame. The process list is cut to fit the window.
+void drawSnapshot(Renderer& renderer, const Snapshot& snapshot,
+                  const DisplayOptions& options);
+
+#endif /* DISPLAY_H */
@@ -0,0 +1,82 @@
+#ifndef PROC_CONNECTOR_H
+#define PROC_CONNECTOR_H
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// A process that was forked and exited again between two ticks
+struct ShortLivedProcess {
+  int pid;
+  int ppid;
+  // From /proc/<pid>/comm if the process still existed when its fork or
+  // exec was seen, else its parent's; empty if neither could be read
+  std::string name;
+  // Exit status as a shell reports it: 128 plus the signal if killed
+  int exitCode;
+  // From fork to exit
+  std::chrono::microseconds lifetime;
+};
+
+// Process lifecycle counts between two ticks
+struct ProcessEvents {
+  // Set when the counts come from the proc connector, i.e. are meaningful
+  bool tracked = false;
+  // Processes forked and processes that exited
+  unsigned long started = 0;
+  unsigned long exited = 0;
+  // Processes that were forked and exited again before a tick saw them
+  unsigned long shortLived = 0;
+  // The first of them, at most maxShortLived
+  std::vector<ShortLivedProcess> shortLivedProcesses;
+  static constexpr size_t maxShortLived = 16;
+};
+
+// Subscription to the kernel proc connector: fork, exec and exit events over
+// netlink. Keeps the set of live PIDs current without listing /proc. Needs
+// CAP_NET_ADMIN in the initial namespaces; open() fails otherwise.
+class ProcConnector {
+ public:
+  ProcConnector() = default;
+  ~ProcConnector();
+  ProcConnector(const ProcConnector&) = delete;
+  ProcConnector& operator=(const ProcConnector&) = delete;
+
+  // Subscribe to the events. Returns false with a reason in error if the
+  // kernel does not deliver them.
+  bool open(std::string& error);
+  bool isOpen() const { return fd >= 0; }
+  // Replace the live set with pids, e.g. after a full /proc scan. Events
+  // already queued are applied on top by the next drain().
+  void reset(const std::vector<int>& pids);
+  // Apply all queued events to the live set and add them to events. Returns
+  // false if events were dropped because the socket overflowed; the live set
+  // must then be rebuilt with reset().
+  bool drain(ProcessEvents& events);
+  // Forget a PID that could not be read, e.g. whose exit event was lost
+  void remove(int pid) { livePids.erase(pid); }
+  const std::unordered_set<int>& pids() const { return livePids; }
+
+ private:
+  // What is known about a process forked within the current drain()
+  struct Forked {
+    int ppid;
+    // Kernel timestamp of the fork event
+    unsigned long long forkNs;
+    std::string name;
+  };
+
+  int fd = -1;
+  std::unordered_set<int> livePids;
+  std::unordered_map<int, Forked> newPids;
+  // Names read within the current drain(), bounded by maxNameReads
+  size_t nameReads = 0;
+  std::vector<char> buffer;
+  std::vector<char> nameBuffer;
+
+  bool readName(int pid, std::string& name);
+};
+
+#endif /* PROC_CONNECTOR_H */
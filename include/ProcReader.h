@@ -0,0 +1,68 @@
+#ifndef PROC_READER_H
+#define PROC_READER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Initial size of the read buffers, large enough for /proc/stat on a few
+// hundred cores and for a typical /proc/<pid>/status
+constexpr size_t procReadBufferSize = 16 * 1024;
+
+// A /proc file that stays open between ticks. Every read() re-reads it from
+// offset 0 with pread() into a buffer that is reused across calls.
+class ProcFile {
+ public:
+  explicit ProcFile(const std::string& path);
+  ~ProcFile();
+  ProcFile(const ProcFile&) = delete;
+  ProcFile& operator=(const ProcFile&) = delete;
+  ProcFile(ProcFile&& other) noexcept;
+  ProcFile& operator=(ProcFile&& other) noexcept;
+
+  // Re-read the whole file. Returns an empty view on error.
+  std::string_view read();
+  bool isOpen() const { return fd >= 0; }
+
+ private:
+  int fd = -1;
+  std::vector<char> buffer;
+};
+
+// Read a short-lived file (e.g. /proc/<pid>/stat) once into the caller's
+// buffer, growing it only if the file does not fit. Returns an empty view on
+// error.
+std::string_view readProcFile(const char* path, std::vector<char>& buffer);
+
+// Fields of /proc/<pid>/stat (or /proc/<pid>/task/<tid>/stat) used by the
+// collectors. Field numbers follow proc(5).
+struct ProcStat {
+  // (2) comm, at most 15 characters, may contain spaces and parentheses
+  std::string_view comm;
+  // (3) state
+  char state;
+  // (4) ppid
+  int ppid;
+  // (14) utime and (15) stime, in clock ticks
+  unsigned long utime;
+  unsigned long stime;
+  // (20) num_threads
+  unsigned long numThreads;
+  // (22) starttime, in clock ticks since boot
+  unsigned long startTime;
+  // (24) rss, in pages
+  unsigned long rssPages;
+};
+
+// Parse a stat file. The comm field is delimited by the first '(' and the
+// last ')', so names containing either are handled correctly.
+bool parseProcStat(std::string_view text, ProcStat& stat);
+
+// Split off the next line of the view (without the '\n')
+std::string_view nextLine(std::string_view& text);
+// Split off the next whitespace-separated token of the view
+std::string_view nextToken(std::string_view& text);
+// Parse the next token of the view as an unsigned integer
+bool nextUnsigned(std::string_view& text, unsigned long& value);
+
+#endif /* PROC_READER_H */
@@ -0,0 +1,87 @@
+#ifndef PROCESS_INFO_H
+#define PROCESS_INFO_H
+
+#include <ostream>
+#include <string>
+
+// R	Running	Actively running on a CPU or ready to run.
+// S	Sleeping (interruptible)	Waiting for an event (e.g., input), but
+// can be woken by signals. D	Sleeping (uninterruptible)	Waiting on I/O;
+// can't be woken by signals. Often device or disk wait. T	Stopped	Stopped
+// by signal (e.g., SIGSTOP or debugger like gdb). Z	Zombie	Process
+// terminated, but parent hasn't read its exit status (via wait()). X	Dead
+// Shouldn't normally appear — indicates a dead/unreachable task (rare). I
+// Idle (kernel threads only)	Idle kernel thread (since Linux 5.14+).
+enum class ProcessState {
+  Running,    // 'R'
+  Sleeping,   // 'S'
+  DiskSleep,  // 'D'
+  Stopped,    // 'T'
+  Zombie,     // 'Z'
+  Dead,       // 'X'
+  Idle,       // 'I'
+  Unknown,    // For any unexpected state
+};
+
+// Human-readable state name
+const char* processStateName(ProcessState state);
+
+std::ostream& operator<<(std::ostream& os, const ProcessState& state);
+
+// Structure describing process
+struct ProcessInfo {
+  // Process PID
+  int pid;
+  // Process name
+  std::string name;
+  // Process state
+  ProcessState state;
+  // CPU used by process in percent
+  double cpuUsed;
+  // Set when the process was not re-read on this tick (adaptive sampling)
+  // and cpuUsed is the rate measured by its last read
+  bool cpuEstimated;
+  // RAM used by process in percent
+  unsigned long memUsedKB;
+  // Parent process PID
+  int ppid;
+  // Number of threads in the process
+  unsigned long threads;
+  // Process start time in clock ticks since boot
+  unsigned long startTime;
+  // Swap used by process in KB, only read with ProcessTable::FieldSwap
+  unsigned long swapKB;
+  // Proportional set size (shared pages split between their users) and
+  // unique set size (private pages only), in KB. Read from
+  // /proc/<pid>/smaps_rollup within a budget, so possibly a few ticks old;
+  // 0 if not read yet.
+  unsigned long pssKB;
+  unsigned long ussKB;
+  // Bytes per second read from and written to storage, from
+  // /proc/<pid>/io; only with ProcessTable::FieldIo
+  double readBytesPerSec;
+  double writeBytesPerSec;
+  // Tree order only: levels below the top of the tree, and CPU in percent
+  // and RAM in KB summed over the process and all its descendants
+  unsigned depth;
+  double subtreeCpuUsed;
+  unsigned long subtreeMemKB;
+};
+
+std::ostream& operator<<(std::ostream& os, const ProcessInfo& info);
+
+// Structure describing one thread of a process
+struct ThreadInfo {
+  // Thread ID
+  int tid;
+  // PID of the process the thread belongs to
+  int pid;
+  // Thread name
+  std::string name;
+  // Thread state
+  ProcessState state;
+  // CPU used by the thread in percent
+  double cpuUsed;
+};
+
+#endif /* PROCESS_INFO_H */
@@ -0,0 +1,92 @@
+#ifndef PROCESS_STORE_H
+#define PROCESS_STORE_H
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ProcessInfo.h"
+
+// Key to order the process table by
+enum class SortKey {
+  Cpu,     // highest CPU usage first
+  Memory,  // highest RSS first
+  Pid,     // lowest PID first
+  Io,      // most bytes read and written per second first
+};
+
+// Per-process state that lives across ticks, keyed by integer PID and stored
+// as one column per field. Rows are unordered; removing a row moves the last
+// row into its place.
+class ProcessStore {
+ public:
+  static constexpr size_t npos = static_cast<size_t>(-1);
+  // pssRssKB of a row whose PSS was never read
+  static constexpr unsigned long pssUnread = static_cast<unsigned long>(-1);
+
+  // Start a new tick. Rows not touched by upsert() before endTick() are
+  // removed.
+  void beginTick();
+  // Row of the PID, appended (with zeroed counters) if it is new
+  size_t upsert(int pid);
+  // Zero the counters of a row as if it had just been appended, for a PID
+  // that now belongs to another process
+  void reset(size_t i);
+  // Row of the PID, or npos if it is not in the store
+  size_t find(int pid) const;
+  // Keep a row that was not re-read on this tick
+  void touch(size_t i) { seenTick[i] = tick; }
+  // Remove the rows of processes that were not seen on this tick
+  void endTick();
+  // PIDs of the rows removed by the last endTick()
+  const std::vector<int>& removedPids() const { return removed; }
+  size_t size() const { return pids.size(); }
+  // Fill rows with the indices of the top n rows by key, best first
+  void selectTop(SortKey key, size_t n, std::vector<size_t>& rows) const;
+  // Copy a row out into a ProcessInfo
+  ProcessInfo row(size_t i) const;
+
+  // Columns, all of size() elements
+  std::vector<int> pids;
+  std::vector<std::string> names;
+  std::vector<ProcessState> states;
+  std::vector<double> cpuUsed;
+  std::vector<unsigned long> memUsedKB;
+  std::vector<int> ppids;
+  std::vector<unsigned long> threads;
+  std::vector<unsigned long> startTimes;
+  std::vector<unsigned long> swapKB;
+  std::vector<unsigned long> pssKB;
+  std::vector<unsigned long> ussKB;
+  // RSS when PSS was last read, to tell which rows changed since; pssUnread
+  // if never
+  std::vector<unsigned long> pssRssKB;
+  // read_bytes and write_bytes of /proc/<pid>/io as of the last read, when
+  // that was (the epoch if never) and the rates measured by it
+  std::vector<unsigned long> ioReadBytes;
+  std::vector<unsigned long> ioWriteBytes;
+  std::vector<std::chrono::steady_clock::time_point> ioReadAt;
+  std::vector<double> readBytesPerSec;
+  std::vector<double> writeBytesPerSec;
+  // utime + stime as of the last read, the base of the next CPU delta
+  std::vector<unsigned long> cpuTicks;
+  // Aggregate CPU time at the last read, the base of the same delta; 0 if
+  // never read
+  std::vector<long> readTotals;
+  // Adaptive sampling: update() on which the row is next due to be re-read,
+  // and how many reads in a row found it idle
+  std::vector<unsigned long> nextReads;
+  std::vector<unsigned> idleReads;
+
+ private:
+  // Tick on which each row was last upserted
+  std::vector<unsigned long> seenTick;
+  unsigned long tick = 0;
+  std::unordered_map<int, size_t> index;
+  std::vector<int> removed;
+
+  void removeRow(size_t i);
+};
+
+#endif /* PROCESS_STORE_H */
@@ -1,58 +1,209 @@
 #ifndef PROCESS_TABLE_H
 #define PROCESS_TABLE_H
 
-#include <iomanip>
+#include <chrono>
+#include <memory>
 #include <string>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 
-// R	Running	Actively running on a CPU or ready to run.
-// S	Sleeping (interruptible)	Waiting for an event (e.g., input), but
-// can be woken by signals. D	Sleeping (uninterruptible)	Waiting on I/O;
-// can't be woken by signals. Often device or disk wait. T	Stopped	Stopped
-// by signal (e.g., SIGSTOP or debugger like gdb). Z	Zombie	Process
-// terminated, but parent hasn't read its exit status (via wait()). X	Dead
-// Shouldn't normally appear — indicates a dead/unreachable task (rare). I
-// Idle (kernel threads only)	Idle kernel thread (since Linux 5.14+).
-enum class ProcessState {
-  Running,    // 'R'
-  Sleeping,   // 'S'
-  DiskSleep,  // 'D'
-  Stopped,    // 'T'
-  Zombie,     // 'Z'
-  Dead,       // 'X'
-  Idle,       // 'I'
-  Unknown,    // For any unexpected state
-};
-
-std::ostream& operator<<(std::ostream& os, const ProcessState& state);
-
-// Structure describing process
-struct ProcessInfo {
-  // Process PID
-  std::string pid;
-  // Process name
-  std::string name;
-  // Process state
-  ProcessState state;
-  // CPU used by process in percent
-  double cpuUsed;
-  // RAM used by process in percent
-  unsigned long memUsedKB;
-};
-
-std::ostream& operator<<(std::ostream& os, const ProcessInfo& info);
+#include "ProcConnector.h"
+#include "ProcReader.h"
+#include "ProcessInfo.h"
+#include "ProcessStore.h"
+#include "ProcessTree.h"
+#include "WorkerPool.h"
 
 class ProcessTable {
  public:
-  // Get info about processes
-  std::vector<ProcessInfo> getProcesses() const;
-  // Print process table header
-  void printTableHeader() const;
-  ProcessTable(unsigned sleepMs = 100) : snapshotsSleepMs(sleepMs) {}
+  // Optional per-process fields. Everything else comes from a single read of
+  // /proc/<pid>/stat; each of these costs one more file per process per tick.
+  enum Field : unsigned {
+    // Untruncated name from /proc/<pid>/comm instead of the 15-character
+    // name in /proc/<pid>/stat (kernel threads may have longer names)
+    FieldFullName = 1 << 0,
+    // VmSwap from /proc/<pid>/status
+    FieldSwap = 1 << 1,
+    // Read and write rates from /proc/<pid>/io. Read for every process only
+    // while sorting by I/O, otherwise for the displayed processes only.
+    FieldIo = 1 << 2,
+  };
+
+  // With scanThreads > 1 the per-PID reads are spread over a worker pool.
+  // procRoot is where procfs is mounted, or a synthetic copy of it.
+  explicit ProcessTable(unsigned fields = 0, unsigned scanThreads = 1,
+                        const std::string& procRoot = "/proc");
+  // Track processes with the proc connector instead of listing /proc on
+  // every update(). Returns false with a reason in error if it is not
+  // available, in which case /proc keeps being listed.
+  bool enableProcEvents(std::string& error);
+  // Read PSS and USS from /proc/<pid>/smaps_rollup, spending at most budget
+  // on it per getTopProcesses(). The returned processes are read first, then
+  // the processes whose RSS changed since their last read, at least one per
+  // call; all others keep their cached values. budget must not be zero.
+  void enablePss(std::chrono::microseconds budget) { pssBudget = budget; }
+  // Re-read processes by activity instead of all of them on every update():
+  // busy and displayed processes on every update, idle ones at doubling
+  // intervals up to maxIdleInterval updates. At most readBudget /proc files
+  // are read per update (0: no limit); the most overdue processes go first.
+  // Skipped processes keep the CPU usage of their last interval, and the
+  // next read measures their usage over the whole time since.
+  void enableAdaptiveSampling(size_t readBudget);
+  static constexpr unsigned long maxIdleInterval = 32;
+  // Keep the parent/child tree of the processes up to date on every
+  // update(), for getProcessTree(). Turning it on builds the tree from the
+  // processes of the last update(); turning it off drops it.
+  void enableTree(bool enable);
+  // Make update() read only these PIDs (e.g. the members of a cgroup)
+  // instead of every process in /proc. Process events stay system-wide.
+  void limitToPids(const std::vector<int>& pids);
+  // Re-read all processes. CPU usage is measured since the previous call.
+  void update();
+  // Number of processes seen by the last update()
+  size_t processCount() const { return store.size(); }
+  // Every process of the last update(), for encoders that want all rows
+  // without copying them out
+  const ProcessStore& processStore() const { return store; }
+  // Lifecycle events seen by the last update(), untracked without
+  // enableProcEvents()
+  const ProcessEvents& processEvents() const { return events; }
+  // The top n processes of the last update() ordered by key
+  std::vector<ProcessInfo> getTopProcesses(size_t n,
+                                           SortKey key = SortKey::Cpu);
+  // The first n processes of the last update() in tree order: depth first,
+  // siblings ordered by their subtree's usage by key (CPU for SortKey::Io),
+  // with depth and the subtree sums filled in. Enables the tree if needed.
+  std::vector<ProcessInfo> getProcessTree(size_t n,
+                                          SortKey key = SortKey::Cpu);
+  // Replace threads with the threads of the first n of procs (as returned by
+  // getTopProcesses()), grouped by process in the same order and busiest
+  // first within each process. Only these processes have their task
+  // directory listed, and only if they used CPU or changed thread count
+  // since it was last read; otherwise the cached threads are reported idle.
+  void getThreads(const std::vector<ProcessInfo>& procs, size_t n,
+                  std::vector<ThreadInfo>& threads);
 
  private:
-  // Time to sleep between consecutive snapshots in ms
-  unsigned snapshotsSleepMs;
+  // Bitmask of Field values to collect
+  unsigned fields;
+  // Fields read for every process on the current tick
+  unsigned scanFields = 0;
+  // Key of the last getTopProcesses()
+  SortKey lastSortKey = SortKey::Cpu;
+  std::string procRoot;
+  // Aggregate CPU time sampled on the previous tick
+  long prevTotalTime = 0;
+  // Number of "cpuN" lines in /proc/stat on the last tick
+  int numCpus = 0;
+  // Processes seen on the last tick and their counters
+  ProcessStore store;
+  // Reused by getTopProcesses() and getProcessTree()
+  std::vector<size_t> topRows;
+  // Absent unless enableTree() turned it on
+  std::unique_ptr<ProcessTree> tree;
+  // (PID, depth) of the rows getProcessTree() returns
+  std::vector<std::pair<int, unsigned>> treeRows;
+  // Zero unless enablePss() was called
+  std::chrono::microseconds pssBudget{0};
+  // Row the next scan for changed PSS starts at, so that every row gets its
+  // turn when the budget runs out
+  size_t pssCursor = 0;
+  std::vector<char> pssBuffer;
+  // Reused for /proc/<pid>/io of the displayed processes
+  std::vector<char> ioBuffer;
+  ProcFile statFile;
+  // Only read when a process is read for the first time
+  ProcFile uptimeFile;
+  // Buffer for getdents64() on /proc
+  std::vector<char> direntBuffer;
+  // PIDs listed on the current tick
+  std::vector<int> pids;
+  // Adaptive sampling state, see enableAdaptiveSampling()
+  bool adaptive = false;
+  size_t readBudget = 0;
+  // Number of update() calls so far
+  unsigned long updates = 0;
+  // Subset of pids re-read on the current tick
+  std::vector<int> readPids;
+  // Due PIDs with their nextReads and readTotals values (0 for new PIDs),
+  // reused by selectReads()
+  std::vector<std::tuple<unsigned long, long, int>> dueReads;
+  // Set by limitToPids()
+  bool pidsLimited = false;
+  std::vector<int> limitPids;
+  // Absent unless enableProcEvents() succeeded
+  std::unique_ptr<ProcConnector> connector;
+  // Set once the connector's PID set has been seeded by a full listing
+  bool connectorSynced = false;
+  ProcessEvents events;
+
+  // read_bytes and write_bytes of /proc/<pid>/io
+  struct IoCounters {
+    unsigned long readBytes = 0;
+    unsigned long writeBytes = 0;
+  };
+
+  // Output of one scan worker, merged once all workers are done
+  struct ScanResult {
+    std::vector<ProcessInfo> procs;
+    // utime + stime of procs[i]
+    std::vector<unsigned long> cpuTimes;
+    // I/O counters of procs[i], with FieldIo in scanFields only
+    std::vector<IoCounters> io;
+    // Reused for every /proc file read by the worker
+    std::vector<char> readBuffer;
+  };
+  std::vector<ScanResult> scanResults;
+  // Absent in single-threaded mode
+  std::unique_ptr<WorkerPool> scanPool;
+
+  // Threads of a process as of the last read of its task directory
+  struct TaskCache {
+    // A different start time means the PID was reused
+    unsigned long startTime = 0;
+    // utime + stime and thread count of the process at that read
+    unsigned long procTicks = 0;
+    unsigned long numThreads = 0;
+    // Aggregate CPU time the next thread deltas are measured against, 0
+    // before the first read
+    long totalTime = 0;
+    // Ordered by TID
+    std::vector<ThreadInfo> threads;
+    // utime + stime of threads[i]
+    std::vector<unsigned long> cpuTicks;
+  };
+  // Processes whose threads were read, dropped once they exit
+  std::unordered_map<int, TaskCache> taskCaches;
+  // Reused by readTasks()
+  std::vector<int> tids;
+  std::vector<ThreadInfo> newThreads;
+  std::vector<unsigned long> newTicks;
+  std::vector<char> taskBuffer;
+
+  // List numeric entries of /proc into pids, or take them from the connector
+  // when it is in sync
+  void listPids();
+  // Pick the PIDs to re-read on this tick into readPids and keep the rows of
+  // the others
+  void selectReads();
+  // Read list[begin, end) into result
+  void scanPids(const std::vector<int>& list, size_t begin, size_t end,
+                ScanResult& result) const;
+  // Re-read the threads of pid into cache
+  void readTasks(int pid, TaskCache& cache);
+  // Clock ticks since boot from /proc/uptime, in the unit of start times; 0
+  // if unknown
+  double uptimeTicks();
+  // Refresh the optional fields of topRows and copy them out, for
+  // getTopProcesses() and getProcessTree()
+  std::vector<ProcessInfo> readTopRows(SortKey key);
+  // Re-read PSS and USS of topRows, then of changed rows, within pssBudget
+  void refreshPss();
+  void readPss(size_t row);
+  // Turn the I/O counters of a row read at time now into rates
+  void setIo(size_t row, const IoCounters& io,
+             std::chrono::steady_clock::time_point now);
 };
 
 #endif /* PROCESS_TABLE_H */
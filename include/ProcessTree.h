@@ -0,0 +1,69 @@
+#ifndef PROCESS_TREE_H
+#define PROCESS_TREE_H
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ProcessStore.h"
+
+// Parent/child links of the process table with CPU and memory summed over
+// every subtree. It is kept up to date one process at a time: a change to a
+// process only walks the path from it to the top, so a tick costs
+// O(changed processes * depth) rather than a rebuild of the whole tree.
+//
+// CPU is kept in hundredths of a percent so that the sums stay exact however
+// many deltas are applied.
+class ProcessTree {
+ public:
+  ProcessTree();
+  // Insert or update a process. A new ppid moves the process with its whole
+  // subtree under the new parent.
+  void set(int pid, int ppid, double cpuUsed, unsigned long memKB);
+  // Remove an exited process. Its children move to the top until they are
+  // set() again with their new parent.
+  void remove(int pid);
+  // Drop every process
+  void clear();
+  size_t size() const { return presentCount; }
+  // Fill rows with the first n processes of a depth-first walk, siblings
+  // ordered by their subtree's CPU (SortKey::Cpu and SortKey::Io), memory
+  // or by PID, as (PID, depth) pairs
+  void select(SortKey key, size_t n,
+              std::vector<std::pair<int, unsigned>>& rows);
+  // CPU in percent and memory in KB of pid and all its descendants, zero if
+  // it is unknown
+  double subtreeCpu(int pid) const;
+  unsigned long subtreeMemKB(int pid) const;
+
+ private:
+  struct Node {
+    // 0 for the top of the tree, which is the node of PID 0
+    int parent = 0;
+    // Position in the parent's children, for constant-time unlinking
+    size_t indexInParent = 0;
+    std::vector<int> children;
+    unsigned long cpu = 0;
+    unsigned long memKB = 0;
+    unsigned long treeCpu = 0;
+    unsigned long treeMemKB = 0;
+    // False for a parent that was referenced by a child before being set()
+    bool present = false;
+  };
+  std::unordered_map<int, Node> nodes;
+  size_t presentCount = 0;
+  // Children being ordered by select(), one range per level of the walk
+  std::vector<int> order;
+
+  // Add to the sums of pid and all its ancestors
+  void addToPath(int pid, unsigned long cpu, unsigned long memKB);
+  // Make node (of pid) the last child of parent
+  void link(int pid, Node& node, int parent);
+  void unlink(Node& node);
+  // Erase a placeholder node once nothing refers to it any more
+  void dropIfUnused(int pid);
+  void walk(int pid, unsigned depth, SortKey key, size_t n,
+            std::vector<std::pair<int, unsigned>>& rows);
+};
+
+#endif /* PROCESS_TREE_H */
@@ -0,0 +1,116 @@
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <stdint.h>
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Collector.h"
+
+// On-disk layout of a recording. The file has a fixed size: a header, a
+// string table for process names and a ring of fixed-size tick slots.
+//
+// Every slot holds one tick encoded as varints. Per-PID values are stored as
+// deltas against the same PID's values in the previous slot; every
+// recordingKeyframeInterval-th slot is a keyframe encoded against zero, so
+// decoding can start there after a seek or once the ring has wrapped.
+constexpr char recordingMagic[8] = {'M', 'T', 'O', 'P', 'R', 'E', 'C', '1'};
+constexpr uint32_t recordingVersion = 1;
+constexpr uint32_t recordingHeaderSize = 4096;
+constexpr uint32_t recordingStringTableSize = 1024 * 1024;
+constexpr uint32_t recordingSlotSize = 64 * 1024;
+constexpr uint64_t recordingKeyframeInterval = 32;
+
+struct RecordingHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t slotSize;
+  uint64_t slotCount;
+  uint32_t stringTableSize;
+  uint32_t stringTableUsed;
+  // Number of slots written so far; slot seq lives at index seq % slotCount
+  uint64_t nextSeq;
+};
+
+// Values of one PID as last written, the base of the next delta
+struct RecordedProcess {
+  uint32_t nameRef;
+  unsigned long cpuCenti;
+  unsigned long memKB;
+  int ppid;
+  unsigned long threads;
+};
+
+// Appends snapshots to a recording file
+class RecordingWriter {
+ public:
+  RecordingWriter() = default;
+  ~RecordingWriter();
+  RecordingWriter(const RecordingWriter&) = delete;
+  RecordingWriter& operator=(const RecordingWriter&) = delete;
+
+  // Create (or truncate) the file with room for slotCount ticks. Returns
+  // false and sets error on failure.
+  bool open(const std::string& path, uint64_t slotCount, std::string& error);
+  // Append a tick: the system totals of snapshot and every process of store,
+  // best first by key. Must not run alongside an update of the store.
+  void write(const Snapshot& snapshot, const ProcessStore& store, SortKey key);
+
+ private:
+  int fd = -1;
+  RecordingHeader header{};
+  // Offset in the string table of every name written so far
+  std::unordered_map<std::string, uint32_t> stringOffsets;
+  std::unordered_map<int, RecordedProcess> prev;
+  // Values of the processes in the slot being written, merged into prev
+  // once it is written out
+  std::vector<std::pair<int, RecordedProcess>> written;
+  std::string slot;
+  std::string procBuffer;
+  // Rows of the store in the order they are written
+  std::vector<size_t> order;
+
+  // Reference to name for the slot: 0 = unchanged, 1 = inline, otherwise
+  // string table offset + 2
+  uint32_t nameRef(const std::string& name);
+};
+
+// Reads a recording through a read-only memory mapping
+class RecordingReader {
+ public:
+  RecordingReader() = default;
+  ~RecordingReader();
+  RecordingReader(const RecordingReader&) = delete;
+  RecordingReader& operator=(const RecordingReader&) = delete;
+
+  bool open(const std::string& path, std::string& error);
+  // Range of decodable slots, [firstSeq(), endSeq())
+  uint64_t firstSeq() const;
+  uint64_t endSeq() const;
+  // Timestamp of a slot without decoding it
+  std::chrono::system_clock::time_point timestamp(uint64_t seq) const;
+  // First slot recorded at or after time (endSeq() - 1 if none)
+  uint64_t seek(std::chrono::system_clock::time_point time) const;
+  // Decode a slot. Sequential reads continue from the previous slot; other
+  // reads decode forward from the preceding keyframe.
+  bool read(uint64_t seq, Snapshot& snapshot);
+
+ private:
+  const char* data = nullptr;
+  size_t size = 0;
+  const RecordingHeader* header = nullptr;
+  std::unordered_map<int, RecordedProcess> prev;
+  // Last slot decoded into prev, or UINT64_MAX
+  uint64_t decodedSeq = UINT64_MAX;
+
+  std::string_view slotPayload(uint64_t seq) const;
+  std::string_view stringAt(uint32_t offset) const;
+  bool decode(uint64_t seq, Snapshot& snapshot);
+};
+
+#endif /* RECORDING_H */
@@ -0,0 +1,106 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <termios.h>
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Draws full-screen frames on an ANSI terminal. Each frame is built line by
+// line into a reused buffer, compared with the previous frame, and only the
+// lines that changed are sent to the terminal in a single write(2).
+class Renderer {
+ public:
+  // Switches the terminal to the alternate screen and hides the cursor
+  explicit Renderer(int fd);
+  // Restores the normal screen and the cursor
+  ~Renderer();
+  Renderer(const Renderer&) = delete;
+  Renderer& operator=(const Renderer&) = delete;
+
+  // Install signal handlers so that resizes are picked up by beginFrame(),
+  // and so that Ctrl-Z hands the terminal back to the shell and fg takes it
+  // again with a full repaint
+  static void watchTerminal();
+  // True if the window was resized (or the process continued) since the
+  // last beginFrame()
+  static bool resizePending();
+
+  // Start a new frame, re-reading the window size if it changed
+  void beginFrame();
+  // Send the lines that differ from the previous frame
+  void endFrame();
+
+  // Window size in character cells
+  int rows() const { return numRows; }
+  int cols() const { return numCols; }
+  // Number of lines added to the current frame so far
+  int lineCount() const { return static_cast<int>(lineEnds.size()); }
+
+  // Append to the current line
+  Renderer& text(std::string_view str);
+  // Append str left-aligned in a field of width cells, truncating it if
+  // longer
+  Renderer& column(std::string_view str, int width);
+  // Same for numbers
+  Renderer& column(unsigned long value, int width);
+  Renderer& column(double value, int precision, int width);
+  // Append a number
+  Renderer& number(unsigned long value);
+  Renderer& number(double value, int precision);
+  // Finish the current line
+  void endLine();
+
+ private:
+  int fd;
+  int numRows = 24;
+  int numCols = 80;
+  // Current and previous frame text, lines concatenated without separators
+  std::string frame;
+  std::string prevFrame;
+  // End offset of every finished line in frame / prevFrame
+  std::vector<size_t> lineEnds;
+  std::vector<size_t> prevLineEnds;
+  // Start of the line being built
+  size_t lineStart = 0;
+  // Escape sequences and changed lines to write out
+  std::string output;
+  // Set when the whole screen has to be repainted
+  bool fullRedraw = true;
+
+  void updateSize();
+  std::string_view line(const std::string& text,
+                        const std::vector<size_t>& ends, size_t i) const;
+};
+
+// Reads single key presses from a terminal switched to non-canonical,
+// no-echo mode for the lifetime of the object
+class KeyReader {
+ public:
+  // Codes returned for keys that send escape sequences
+  enum Key : int {
+    KeyNone = -1,
+    KeyUp = 0x100,
+    KeyDown,
+    KeyRight,
+    KeyLeft,
+  };
+
+  explicit KeyReader(int fd);
+  ~KeyReader();
+  KeyReader(const KeyReader&) = delete;
+  KeyReader& operator=(const KeyReader&) = delete;
+
+  // Wait up to timeout for a key press. Returns the character, one of Key,
+  // or KeyNone on timeout.
+  int readKey(std::chrono::milliseconds timeout);
+
+ private:
+  int fd;
+  bool restore = false;
+  struct termios savedMode;
+};
+
+#endif /* RENDERER_H */
@@ -0,0 +1,116 @@
+#ifndef SELF_STATS_H
+#define SELF_STATS_H
+
+#include <stdint.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+
+// Phases of a tick whose latency is tracked
+enum class Phase {
+  DirScan,   // listing PIDs in /proc
+  Parse,     // reading and parsing /proc/<pid> files
+  CpuDelta,  // per-process CPU deltas and store updates
+  Sort,      // selecting the displayed processes
+  Tasks,     // reading the threads of expanded processes
+  Pss,       // reading /proc/<pid>/smaps_rollup
+  Cgroups,   // walking and reading the cgroup hierarchy
+  Render,    // drawing the screen or writing batch output
+};
+
+constexpr size_t phaseCount = 8;
+
+// Short name of a phase for display
+const char* phaseName(Phase phase);
+
+// Latency histogram with log-linear buckets: 8 linear sub-buckets per power
+// of two, so every bucket is within 12.5% of its value. Updates are single
+// relaxed atomic adds and can come from any thread.
+class LatencyHistogram {
+ public:
+  void record(uint64_t ns);
+  // Approximate value below which the given fraction (0..1) of the samples
+  // fall, 0 if there are none
+  uint64_t percentile(double fraction) const;
+  uint64_t last() const { return lastNs.load(std::memory_order_relaxed); }
+
+ private:
+  static constexpr size_t subBuckets = 8;
+  static constexpr size_t bucketCount = 62 * subBuckets;
+
+  std::array<std::atomic<uint64_t>, bucketCount> counts{};
+  std::atomic<uint64_t> lastNs{0};
+
+  static size_t bucketFor(uint64_t ns);
+  static uint64_t bucketValue(size_t bucket);
+};
+
+// Latency of one phase as reported per tick
+struct PhaseStats {
+  uint64_t lastNs = 0;
+  uint64_t p50Ns = 0;
+  uint64_t p99Ns = 0;
+};
+
+// mini-top's own overhead over one tick
+struct SelfSample {
+  // /proc files opened and bytes read by the collectors during the tick
+  unsigned long filesOpened = 0;
+  unsigned long bytesRead = 0;
+  // Own CPU usage over the tick, as a percentage of one core
+  double cpuPercent = 0;
+  // Own resident set size
+  unsigned long rssKB = 0;
+  std::array<PhaseStats, phaseCount> phases{};
+};
+
+// Process-wide instrumentation of mini-top itself
+class SelfStats {
+ public:
+  static SelfStats& instance();
+
+  void recordPhase(Phase phase, uint64_t ns) {
+    histograms[static_cast<size_t>(phase)].record(ns);
+  }
+  void countRead(size_t bytes) {
+    bytesRead.fetch_add(bytes, std::memory_order_relaxed);
+  }
+  void countOpen() { filesOpened.fetch_add(1, std::memory_order_relaxed); }
+
+  // Fill sample with the counters accumulated since the previous call
+  void sample(SelfSample& sample);
+
+ private:
+  std::array<LatencyHistogram, phaseCount> histograms;
+  std::atomic<unsigned long> filesOpened{0};
+  std::atomic<unsigned long> bytesRead{0};
+
+  // State of the previous sample()
+  unsigned long prevFilesOpened = 0;
+  unsigned long prevBytesRead = 0;
+  std::chrono::steady_clock::time_point prevTime;
+  std::chrono::microseconds prevCpuTime{0};
+};
+
+// Records the lifetime of the object as one sample of a phase
+class PhaseTimer {
+ public:
+  explicit PhaseTimer(Phase phase)
+      : phase(phase), start(std::chrono::steady_clock::now()) {}
+  ~PhaseTimer() {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    SelfStats::instance().recordPhase(
+        phase,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+  }
+  PhaseTimer(const PhaseTimer&) = delete;
+  PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+ private:
+  Phase phase;
+  std::chrono::steady_clock::time_point start;
+};
+
+#endif /* SELF_STATS_H */
@@ -0,0 +1,124 @@
+#ifndef SHARED_SNAPSHOT_H
+#define SHARED_SNAPSHOT_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include "Collector.h"
+
+// Layout of the POSIX shared-memory segment through which one sampling
+// instance publishes its snapshots to any number of read-only viewers: a
+// header page followed by two slots holding one encoded Snapshot each.
+//
+// The slots are written alternately and each is guarded by a sequence number
+// that is odd while it is being written (a seqlock). generation names the
+// latest complete snapshot, which lives in slot generation % 2, so the
+// publisher always fills the slot the viewers are not reading; a viewer only
+// retries if copying a snapshot out takes longer than a whole tick.
+constexpr char sharedSnapshotMagic[8] = {'M', 'T', 'O', 'P', 'S', 'H', 'M', '1'};
+constexpr uint32_t sharedSnapshotVersion = 4;
+constexpr size_t sharedSnapshotHeaderSize = 4096;
+constexpr size_t sharedSnapshotSlotHeaderSize = 64;
+constexpr size_t sharedSnapshotSlotSize = 4 * 1024 * 1024;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "shared-memory atomics must not need a lock");
+
+struct SharedSnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  // SnapshotPublisher::Show bits, what the publisher collects
+  uint32_t flags;
+  uint64_t slotSize;
+  int32_t publisherPid;
+  uint32_t intervalMs;
+  // Latest complete snapshot, 0 before the first one
+  std::atomic<uint64_t> generation;
+  // Set once the publisher has stopped
+  std::atomic<uint32_t> closed;
+};
+
+struct SharedSnapshotSlot {
+  // Odd while the slot is being written
+  std::atomic<uint64_t> seq;
+  // Bytes of encoded snapshot following the slot header
+  uint64_t size;
+};
+
+// Publishes snapshots into a shared-memory segment
+class SnapshotPublisher {
+ public:
+  // Optional contents of the published snapshots, for the viewers' display
+  enum Show : uint32_t {
+    ShowSwap = 1 << 0,
+    ShowPss = 1 << 1,
+    ShowIo = 1 << 2,
+    ShowCgroups = 1 << 3,
+    ShowSelfStats = 1 << 4,
+  };
+
+  SnapshotPublisher() = default;
+  // Marks the segment closed and unlinks it; attached viewers keep their
+  // mapping until they detach
+  ~SnapshotPublisher();
+  SnapshotPublisher(const SnapshotPublisher&) = delete;
+  SnapshotPublisher& operator=(const SnapshotPublisher&) = delete;
+
+  // Create the segment called name (see shm_open(3)), replacing one left
+  // behind by a publisher that is gone. Returns false and sets error on
+  // failure, if another live publisher owns the name or if the name holds
+  // something other than a mini-top segment.
+  bool open(const std::string& name, uint32_t flags,
+            std::chrono::milliseconds interval, std::string& error);
+  // Publish a snapshot. Process and thread rows that do not fit in a slot
+  // are dropped.
+  void write(const Snapshot& snapshot);
+
+ private:
+  std::string name;
+  char* data = nullptr;
+  size_t size = 0;
+  SharedSnapshotHeader* header = nullptr;
+  std::string encoded;
+};
+
+// Reads the snapshots of a publisher through a read-only mapping
+class SnapshotViewer {
+ public:
+  SnapshotViewer() = default;
+  ~SnapshotViewer();
+  SnapshotViewer(const SnapshotViewer&) = delete;
+  SnapshotViewer& operator=(const SnapshotViewer&) = delete;
+
+  // Attach to the segment called name. On success the previous segment is
+  // detached, on failure it stays attached.
+  bool open(const std::string& name, std::string& error);
+  // SnapshotPublisher::Show bits of the publisher
+  uint32_t flags() const { return header->flags; }
+  std::chrono::milliseconds interval() const {
+    return std::chrono::milliseconds(header->intervalMs);
+  }
+  // Latest published generation, 0 if none yet; cheap enough to poll
+  uint64_t generation() const {
+    return header->generation.load(std::memory_order_acquire);
+  }
+  int publisherPid() const { return header->publisherPid; }
+  // Whether the publisher stopped or died
+  bool closed() const;
+  // Copy out and decode the latest snapshot. Returns false if there is none
+  // or it kept changing under the copy.
+  bool read(Snapshot& snapshot);
+
+ private:
+  char* data = nullptr;
+  size_t size = 0;
+  const SharedSnapshotHeader* header = nullptr;
+  std::string copy;
+
+  void close();
+};
+
+#endif /* SHARED_SNAPSHOT_H */
@@ -3,14 +3,32 @@
 
 #include <stdint.h>
 
-#include <fstream>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
-// Describes RAM usage
+#include "ProcReader.h"
+
+// Describes RAM usage, from /proc/meminfo
 struct MemoryUsage {
   long totalKB;
+  long freeKB;
   long availableKB;
+  long buffersKB;
+  // Page cache, including shmemKB
+  long cachedKB;
+  // Slab memory the kernel can reclaim, counted as cache
+  long sReclaimableKB;
+  // Shared memory and tmpfs, cannot be dropped like the rest of the cache
+  long shmemKB;
+  long swapTotalKB;
+  long swapFreeKB;
+  // totalKB minus free memory, buffers and reclaimable cache
   long usedKB;
+  long swapUsedKB;
+  // usedKB relative to totalKB
   double usedPercent;
 };
 
@@ -20,6 +38,18 @@ struct CpuUsage {
   std::vector<double> perCoreUsage;
 };
 
+// Activity of one block device between two ticks, from /proc/diskstats
+struct DiskUsage {
+  std::string name;
+  // Completed requests per second
+  double readsPerSec;
+  double writesPerSec;
+  double readBytesPerSec;
+  double writeBytesPerSec;
+  // Share of the time the device had requests in flight, in percent
+  double utilization;
+};
+
 // CPU activity information
 struct CpuTimes {
   // Describes total amount of time spent by CPU
@@ -31,19 +61,52 @@ struct CpuTimes {
 // Collect system metrics (CPU/RAM usage)
 class SystemInfo {
  public:
-  // Get CPU usage info
-  CpuUsage getCpuUsage() const;
+  // procRoot and sysRoot are where procfs and sysfs are mounted, or
+  // synthetic copies of them
+  explicit SystemInfo(const std::string& procRoot = "/proc",
+                      const std::string& sysRoot = "/sys");
+  // Get CPU usage accumulated since the previous call. The first call reports
+  // the average since boot.
+  CpuUsage getCpuUsage();
   // Get RAM usage info
-  MemoryUsage getMemoryUsage() const;
-  // Get CPU times info (total/idle)
-  CpuTimes getCpuTimes(std::string& str) const;
-  SystemInfo(unsigned sleepMs = 100) : snapshotsSleepMs(sleepMs) {}
+  MemoryUsage getMemoryUsage();
+  // Replace disks with the activity of every physical disk since the
+  // previous call: the devices of /sys/block backed by hardware. Partitions
+  // and virtual devices (loop, zram, device-mapper, md) are left out, so no
+  // I/O is counted twice. The first call reports zero rates.
+  void getDiskUsage(std::vector<DiskUsage>& disks);
+  // Get CPU times info (total/idle) from a "cpu" line of /proc/stat
+  static CpuTimes getCpuTimes(std::string_view line);
 
  private:
-  // Time to sleep between consecutive snapshots in ms
-  unsigned snapshotsSleepMs;
+  // /proc/stat and /proc/meminfo are kept open and re-read every tick
+  ProcFile statFile;
+  ProcFile meminfoFile;
+  ProcFile diskstatsFile;
+  // Aggregate CPU times sampled on the previous tick
+  CpuTimes prevTotal{};
+  // Per-core CPU times sampled on the previous tick
+  std::vector<CpuTimes> prevPerCore;
+  // Per-core CPU times of the current tick, kept to reuse its storage
+  std::vector<CpuTimes> curPerCore;
+  // Counters of a disk as of the previous getDiskUsage()
+  struct DiskCounters {
+    std::string name;
+    unsigned long reads;
+    unsigned long sectorsRead;
+    unsigned long writes;
+    unsigned long sectorsWritten;
+    unsigned long ioMs;
+  };
+  std::string sysRoot;
+  // Whether each device name seen in diskstats is a physical disk
+  std::unordered_map<std::string, bool> physicalDisks;
+  std::vector<DiskCounters> prevDisks;
+  std::vector<DiskCounters> curDisks;
+  std::chrono::steady_clock::time_point prevDiskTime;
+  bool isPhysicalDisk(std::string_view name);
   // Get CPU per-core usage info
-  void collectPerCoreSnapshots(std::ifstream& statFile, unsigned numCores,
+  void collectPerCoreSnapshots(std::string_view& stat,
                                std::vector<CpuTimes>& snapshots) const;
 };
 
@@ -0,0 +1,58 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed pool of threads that process a range of items split into shards.
+// Each worker starts on its own contiguous block of shards and steals shards
+// from the other workers' blocks once its block is drained.
+class WorkerPool {
+ public:
+  // Called with the worker index and a [begin, end) range of item indices
+  using ShardFn = std::function<void(unsigned, size_t, size_t)>;
+
+  // The calling thread acts as worker 0, so numWorkers - 1 threads are
+  // started
+  explicit WorkerPool(unsigned numWorkers);
+  ~WorkerPool();
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  unsigned size() const { return numWorkers; }
+  // Process items [0, count) in shards of shardSize and wait for completion
+  void run(size_t count, size_t shardSize, const ShardFn& fn);
+
+ private:
+  // Shard cursor of one worker. The owner and thieves both claim shards with
+  // fetch_add, so no lock is needed.
+  struct alignas(64) ShardQueue {
+    std::atomic<size_t> next{0};
+    size_t end = 0;
+  };
+
+  unsigned numWorkers;
+  std::unique_ptr<ShardQueue[]> queues;
+  std::vector<std::thread> threads;
+
+  // State of the current run, guarded by mutex
+  std::mutex mutex;
+  std::condition_variable startCv;
+  std::condition_variable doneCv;
+  unsigned long generation = 0;
+  unsigned pending = 0;
+  bool stopping = false;
+  const ShardFn* shardFn = nullptr;
+  size_t itemCount = 0;
+  size_t shardSize = 1;
+
+  void workerLoop(unsigned worker);
+  void processShards(unsigned worker);
+};
+
+#endif /* WORKER_POOL_H */
@@ -0,0 +1,523 @@
+#include "BatchWriter.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <charconv>
+
+BatchWriter::BatchWriter(int fd, BatchFormat format, size_t maxProcesses,
+                         bool selfStats, bool pss, bool io, bool tree)
+    : fd(fd),
+      format(format),
+      maxProcesses(maxProcesses),
+      selfStats(selfStats),
+      pss(pss),
+      io(io),
+      tree(tree) {
+  buffer.reserve(64 * 1024);
+}
+
+void BatchWriter::appendNumber(unsigned long value) {
+  char digits[32];
+  auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), value);
+
+  buffer.append(digits, end - digits);
+}
+
+void BatchWriter::appendNumber(double value) {
+  char digits[64];
+  auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), value,
+                                 std::chars_format::fixed, 2);
+
+  if (ec != std::errc()) {
+    buffer += '0';
+    return;
+  }
+  buffer.append(digits, end - digits);
+}
+
+void BatchWriter::appendCsvString(std::string_view str) {
+  if (str.find_first_of(",\"\n") == std::string_view::npos) {
+    buffer += str;
+    return;
+  }
+
+  buffer += '"';
+  for (char c : str) {
+    if (c == '"') buffer += '"';
+    buffer += c;
+  }
+  buffer += '"';
+}
+
+void BatchWriter::appendJsonString(std::string_view str) {
+  static const char hex[] = "0123456789abcdef";
+
+  buffer += '"';
+  for (char c : str) {
+    unsigned char u = static_cast<unsigned char>(c);
+
+    if (c == '"' || c == '\\') {
+      buffer += '\\';
+      buffer += c;
+    } else if (u < 0x20) {
+      buffer += "\\u00";
+      buffer += hex[u >> 4];
+      buffer += hex[u & 0xf];
+    } else {
+      buffer += c;
+    }
+  }
+  buffer += '"';
+}
+
+static unsigned long toMillis(std::chrono::system_clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             time.time_since_epoch())
+      .count();
+}
+
+void BatchWriter::writeCsv(const Snapshot& snapshot) {
+  unsigned long timestamp = toMillis(snapshot.timestamp);
+
+  // Self stats add columns, left empty on the other rows
+  const char* selfColumns = selfStats ? ",,,," : "";
+  if (!headerWritten) {
+    // Whether the events are tracked does not change after the first tick
+    events = snapshot.events.tracked;
+    buffer +=
+        "type,timestamp_ms,tick,id,name,state,cpu_percent,mem_kb,"
+        "mem_total_kb,mem_available_kb,mem_percent";
+    if (selfStats) {
+      buffer += ",files_opened,bytes_read,latency_p50_us,latency_p99_us";
+    }
+    if (pss) buffer += ",pss_kb,uss_kb";
+    if (io) buffer += ",read_bytes_per_sec,write_bytes_per_sec";
+    if (tree) buffer += ",ppid,depth,subtree_cpu_percent,subtree_mem_kb";
+    if (events) buffer += ",parent_pid,exit_code,lifetime_ms";
+    buffer += '\n';
+    headerWritten = true;
+  }
+
+  // So do PSS and USS, then the I/O rates, the tree columns and the
+  // short-lived process columns, after the self stats columns. Disks only
+  // have a row with I/O rates.
+  std::string extraColumns = pss ? ",," : "";
+  const char* eventColumns = events ? ",,," : "";
+
+  if (io) extraColumns += ",,";
+  if (tree) extraColumns += ",,,,";
+  extraColumns += eventColumns;
+
+  // Common prefix of every row of this tick
+  auto row = [&](const char* type) {
+    buffer += type;
+    buffer += ',';
+    appendNumber(timestamp);
+    buffer += ',';
+    appendNumber(snapshot.tick);
+    buffer += ',';
+  };
+
+  row("sys");
+  buffer += ",,,";
+  appendNumber(snapshot.cpu.totalUsage);
+  buffer += ',';
+  appendNumber(static_cast<unsigned long>(snapshot.mem.usedKB));
+  buffer += ',';
+  appendNumber(static_cast<unsigned long>(snapshot.mem.totalKB));
+  buffer += ',';
+  appendNumber(static_cast<unsigned long>(snapshot.mem.availableKB));
+  buffer += ',';
+  appendNumber(snapshot.mem.usedPercent);
+  buffer += selfColumns;
+  buffer += extraColumns;
+  buffer += '\n';
+
+  for (size_t i = 0; i < snapshot.cpu.perCoreUsage.size(); i++) {
+    row("core");
+    appendNumber(i);
+    buffer += ",,,";
+    appendNumber(snapshot.cpu.perCoreUsage[i]);
+    buffer += ",,,,";
+    buffer += selfColumns;
+    buffer += extraColumns;
+    buffer += '\n';
+  }
+
+  for (const DiskUsage& disk : snapshot.disks) {
+    row("disk");
+    appendCsvString(disk.name);
+    buffer += ",,,";
+    appendNumber(disk.utilization);
+    buffer += ",,,,";
+    buffer += selfColumns;
+    if (pss) buffer += ",,";
+    buffer += ',';
+    appendNumber(disk.readBytesPerSec);
+    buffer += ',';
+    appendNumber(disk.writeBytesPerSec);
+    if (tree) buffer += ",,,,";
+    buffer += eventColumns;
+    buffer += '\n';
+  }
+
+  for (size_t i = 0; i < std::min(snapshot.cgroups.size(), maxProcesses);
+       i++) {
+    const CgroupInfo& cgroup = snapshot.cgroups[i];
+
+    row("cgroup");
+    appendCsvString(cgroup.path);
+    buffer += ",,,";
+    appendNumber(cgroup.cpuUsed);
+    buffer += ',';
+    appendNumber(cgroup.memCurrentKB);
+    buffer += ",,,";
+    buffer += selfColumns;
+    buffer += extraColumns;
+    buffer += '\n';
+  }
+
+  size_t count = std::min(snapshot.processes.size(), maxProcesses);
+  // Threads are grouped by process in the same order as the processes
+  size_t thread = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    const ProcessInfo& info = snapshot.processes[i];
+
+    row("proc");
+    appendNumber(static_cast<unsigned long>(info.pid));
+    buffer += ',';
+    appendCsvString(info.name);
+    buffer += ',';
+    buffer += processStateName(info.state);
+    buffer += ',';
+    appendNumber(info.cpuUsed);
+    buffer += ',';
+    appendNumber(info.memUsedKB);
+    buffer += ",,,";
+    buffer += selfColumns;
+    if (pss) {
+      buffer += ',';
+      appendNumber(info.pssKB);
+      buffer += ',';
+      appendNumber(info.ussKB);
+    }
+    if (io) {
+      buffer += ',';
+      appendNumber(info.readBytesPerSec);
+      buffer += ',';
+      appendNumber(info.writeBytesPerSec);
+    }
+    if (tree) {
+      buffer += ',';
+      appendNumber(static_cast<unsigned long>(info.ppid));
+      buffer += ',';
+      appendNumber(static_cast<unsigned long>(info.depth));
+      buffer += ',';
+      appendNumber(info.subtreeCpuUsed);
+      buffer += ',';
+      appendNumber(info.subtreeMemKB);
+    }
+    buffer += eventColumns;
+    buffer += '\n';
+
+    for (; thread < snapshot.threads.size() &&
+           snapshot.threads[thread].pid == info.pid;
+         thread++) {
+      const ThreadInfo& task = snapshot.threads[thread];
+
+      row("thread");
+      appendNumber(static_cast<unsigned long>(task.tid));
+      buffer += ',';
+      appendCsvString(task.name);
+      buffer += ',';
+      buffer += processStateName(task.state);
+      buffer += ',';
+      appendNumber(task.cpuUsed);
+      buffer += ",,,,";
+      buffer += selfColumns;
+      buffer += extraColumns;
+      buffer += '\n';
+    }
+  }
+
+  for (const ShortLivedProcess& proc : snapshot.events.shortLivedProcesses) {
+    row("shortlived");
+    appendNumber(static_cast<unsigned long>(proc.pid));
+    buffer += ',';
+    appendCsvString(proc.name);
+    buffer += ",,,,,,";
+    buffer += selfColumns;
+    if (pss) buffer += ",,";
+    if (io) buffer += ",,";
+    if (tree) buffer += ",,,,";
+    buffer += ',';
+    appendNumber(static_cast<unsigned long>(proc.ppid));
+    buffer += ',';
+    appendNumber(static_cast<unsigned long>(proc.exitCode));
+    buffer += ',';
+    appendNumber(proc.lifetime.count() / 1000.0);
+    buffer += '\n';
+  }
+
+  if (!selfStats) return;
+
+  const SelfSample& self = snapshot.self;
+
+  row("self");
+  buffer += ",,,";
+  appendNumber(self.cpuPercent);
+  buffer += ',';
+  appendNumber(self.rssKB);
+  buffer += ",,,,";
+  appendNumber(self.filesOpened);
+  buffer += ',';
+  appendNumber(self.bytesRead);
+  buffer += ",,";
+  buffer += extraColumns;
+  buffer += '\n';
+
+  for (size_t i = 0; i < phaseCount; i++) {
+    row("phase");
+    buffer += phaseName(static_cast<Phase>(i));
+    buffer += ",,,,,,,,,,";
+    appendNumber(self.phases[i].p50Ns / 1000.0);
+    buffer += ',';
+    appendNumber(self.phases[i].p99Ns / 1000.0);
+    buffer += extraColumns;
+    buffer += '\n';
+  }
+}
+
+void BatchWriter::writeJson(const Snapshot& snapshot) {
+  buffer += "{\"timestamp_ms\":";
+  appendNumber(toMillis(snapshot.timestamp));
+  buffer += ",\"tick\":";
+  appendNumber(snapshot.tick);
+  buffer += ",\"missed_deadlines\":";
+  appendNumber(snapshot.missedDeadlines);
+
+  buffer += ",\"cpu\":{\"total\":";
+  appendNumber(snapshot.cpu.totalUsage);
+  buffer += ",\"cores\":[";
+  for (size_t i = 0; i < snapshot.cpu.perCoreUsage.size(); i++) {
+    if (i > 0) buffer += ',';
+    appendNumber(snapshot.cpu.perCoreUsage[i]);
+  }
+
+  buffer += "]},\"mem\":{\"total_kb\":";
+  appendNumber(static_cast<unsigned long>(snapshot.mem.totalKB));
+  buffer += ",\"used_kb\":";
+  appendNumber(static_cast<unsigned long>(snapshot.mem.usedKB));
+  buffer += ",\"available_kb\":";
+  appendNumber(static_cast<unsigned long>(snapshot.mem.availableKB));
+  buffer += ",\"used_percent\":";
+  appendNumber(snapshot.mem.usedPercent);
+  buffer += ",\"buffers_kb\":";
+  appendNumber(static_cast<unsigned long>(snapshot.mem.buffersKB));
+  buffer += ",\"cached_kb\":";
+  appendNumber(static_cast<unsigned long>(snapshot.mem.cachedKB));
+  buffer += ",\"sreclaimable_kb\":";
+  appendNumber(static_cast<unsigned long>(snapshot.mem.sReclaimableKB));
+  buffer += ",\"shmem_kb\":";
+  appendNumber(static_cast<unsigned long>(snapshot.mem.shmemKB));
+  buffer += ",\"swap_total_kb\":";
+  appendNumber(static_cast<unsigned long>(snapshot.mem.swapTotalKB));
+  buffer += ",\"swap_used_kb\":";
+  appendNumber(static_cast<unsigned long>(snapshot.mem.swapUsedKB));
+
+  buffer += '}';
+  if (!snapshot.disks.empty()) {
+    buffer += ",\"disks\":[";
+    for (size_t i = 0; i < snapshot.disks.size(); i++) {
+      const DiskUsage& disk = snapshot.disks[i];
+
+      if (i > 0) buffer += ',';
+      buffer += "{\"name\":";
+      appendJsonString(disk.name);
+      buffer += ",\"reads_per_sec\":";
+      appendNumber(disk.readsPerSec);
+      buffer += ",\"writes_per_sec\":";
+      appendNumber(disk.writesPerSec);
+      buffer += ",\"read_bytes_per_sec\":";
+      appendNumber(disk.readBytesPerSec);
+      buffer += ",\"write_bytes_per_sec\":";
+      appendNumber(disk.writeBytesPerSec);
+      buffer += ",\"util_percent\":";
+      appendNumber(disk.utilization);
+      buffer += '}';
+    }
+    buffer += ']';
+  }
+  if (!snapshot.cgroups.empty()) {
+    buffer += ",\"cgroup_count\":";
+    appendNumber(snapshot.cgroupCount);
+    buffer += ",\"cgroups\":[";
+    for (size_t i = 0; i < std::min(snapshot.cgroups.size(), maxProcesses);
+         i++) {
+      const CgroupInfo& cgroup = snapshot.cgroups[i];
+
+      if (i > 0) buffer += ',';
+      buffer += "{\"path\":";
+      appendJsonString(cgroup.path);
+      buffer += ",\"cpu_percent\":";
+      appendNumber(cgroup.cpuUsed);
+      buffer += ",\"mem_kb\":";
+      appendNumber(cgroup.memCurrentKB);
+      buffer += ",\"anon_kb\":";
+      appendNumber(cgroup.memAnonKB);
+      buffer += ",\"file_kb\":";
+      appendNumber(cgroup.memFileKB);
+      buffer += ",\"read_bytes_per_sec\":";
+      appendNumber(cgroup.readBytesPerSec);
+      buffer += ",\"write_bytes_per_sec\":";
+      appendNumber(cgroup.writeBytesPerSec);
+      buffer += '}';
+    }
+    buffer += "],\"expanded_cgroup\":";
+    appendJsonString(snapshot.expandedCgroup);
+  }
+  buffer += ",\"process_count\":";
+  appendNumber(snapshot.processCount);
+  if (snapshot.events.tracked) {
+    buffer += ",\"process_events\":{\"started\":";
+    appendNumber(snapshot.events.started);
+    buffer += ",\"exited\":";
+    appendNumber(snapshot.events.exited);
+    buffer += ",\"short_lived\":";
+    appendNumber(snapshot.events.shortLived);
+    buffer += ",\"short_lived_processes\":[";
+    for (size_t i = 0; i < snapshot.events.shortLivedProcesses.size(); i++) {
+      const ShortLivedProcess& proc = snapshot.events.shortLivedProcesses[i];
+
+      if (i > 0) buffer += ',';
+      buffer += "{\"pid\":";
+      appendNumber(static_cast<unsigned long>(proc.pid));
+      buffer += ",\"ppid\":";
+      appendNumber(static_cast<unsigned long>(proc.ppid));
+      buffer += ",\"name\":";
+      appendJsonString(proc.name);
+      buffer += ",\"exit_code\":";
+      appendNumber(static_cast<unsigned long>(proc.exitCode));
+      buffer += ",\"lifetime_ms\":";
+      appendNumber(proc.lifetime.count() / 1000.0);
+      buffer += '}';
+    }
+    buffer += "]}";
+  }
+  buffer += ",\"processes\":[";
+
+  size_t thread = 0;
+
+  for (size_t i = 0; i < std::min(snapshot.processes.size(), maxProcesses);
+       i++) {
+    const ProcessInfo& info = snapshot.processes[i];
+
+    if (i > 0) buffer += ',';
+    buffer += "{\"pid\":";
+    appendNumber(static_cast<unsigned long>(info.pid));
+    buffer += ",\"name\":";
+    appendJsonString(info.name);
+    buffer += ",\"state\":\"";
+    buffer += processStateName(info.state);
+    buffer += "\",\"cpu_percent\":";
+    appendNumber(info.cpuUsed);
+    buffer += ",\"mem_kb\":";
+    appendNumber(info.memUsedKB);
+    if (pss) {
+      buffer += ",\"pss_kb\":";
+      appendNumber(info.pssKB);
+      buffer += ",\"uss_kb\":";
+      appendNumber(info.ussKB);
+    }
+    if (io) {
+      buffer += ",\"read_bytes_per_sec\":";
+      appendNumber(info.readBytesPerSec);
+      buffer += ",\"write_bytes_per_sec\":";
+      appendNumber(info.writeBytesPerSec);
+    }
+    if (snapshot.tree) {
+      buffer += ",\"ppid\":";
+      appendNumber(static_cast<unsigned long>(info.ppid));
+      buffer += ",\"depth\":";
+      appendNumber(static_cast<unsigned long>(info.depth));
+      buffer += ",\"subtree_cpu_percent\":";
+      appendNumber(info.subtreeCpuUsed);
+      buffer += ",\"subtree_mem_kb\":";
+      appendNumber(info.subtreeMemKB);
+    }
+
+    // Only expanded processes get a thread list
+    if (thread < snapshot.threads.size() &&
+        snapshot.threads[thread].pid == info.pid) {
+      buffer += ",\"threads\":[";
+      for (size_t first = thread; thread < snapshot.threads.size() &&
+                                  snapshot.threads[thread].pid == info.pid;
+           thread++) {
+        const ThreadInfo& task = snapshot.threads[thread];
+
+        if (thread > first) buffer += ',';
+        buffer += "{\"tid\":";
+        appendNumber(static_cast<unsigned long>(task.tid));
+        buffer += ",\"name\":";
+        appendJsonString(task.name);
+        buffer += ",\"state\":\"";
+        buffer += processStateName(task.state);
+        buffer += "\",\"cpu_percent\":";
+        appendNumber(task.cpuUsed);
+        buffer += '}';
+      }
+      buffer += ']';
+    }
+    buffer += '}';
+  }
+  buffer += ']';
+
+  if (selfStats) {
+    const SelfSample& self = snapshot.self;
+
+    buffer += ",\"self\":{\"cpu_percent\":";
+    appendNumber(self.cpuPercent);
+    buffer += ",\"rss_kb\":";
+    appendNumber(self.rssKB);
+    buffer += ",\"files_opened\":";
+    appendNumber(self.filesOpened);
+    buffer += ",\"bytes_read\":";
+    appendNumber(self.bytesRead);
+    buffer += ",\"latency_us\":{";
+    for (size_t i = 0; i < phaseCount; i++) {
+      if (i > 0) buffer += ',';
+      buffer += '"';
+      buffer += phaseName(static_cast<Phase>(i));
+      buffer += "\":{\"p50\":";
+      appendNumber(self.phases[i].p50Ns / 1000.0);
+      buffer += ",\"p99\":";
+      appendNumber(self.phases[i].p99Ns / 1000.0);
+      buffer += '}';
+    }
+    buffer += "}}";
+  }
+  buffer += "}\n";
+}
+
+void BatchWriter::write(const Snapshot& snapshot) {
+  PhaseTimer timer(Phase::Render);
+
+  buffer.clear();
+
+  if (format == BatchFormat::Csv) {
+    writeCsv(snapshot);
+  } else {
+    writeJson(snapshot);
+  }
+
+  std::string_view data = buffer;
+
+  while (!data.empty()) {
+    ssize_t n = ::write(fd, data.data(), data.size());
+
+    if (n <= 0) return;
+    data.remove_prefix(n);
+  }
+}
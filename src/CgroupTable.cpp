@@ -0,0 +1,214 @@
+#include "CgroupTable.h"
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "ProcReader.h"
+#include "SelfStats.h"
+
+CgroupTable::CgroupTable(const std::string& root)
+    : root(root), readBuffer(procReadBufferSize) {}
+
+// Value of the "key value" line of a flat-keyed file such as cpu.stat
+static unsigned long keyedValue(std::string_view text, std::string_view key) {
+  while (!text.empty()) {
+    std::string_view line = nextLine(text);
+    unsigned long value = 0;
+
+    if (nextToken(line) == key && nextUnsigned(line, value)) return value;
+  }
+  return 0;
+}
+
+void CgroupTable::readCgroup(std::string_view path,
+                             std::chrono::steady_clock::time_point now) {
+  size_t dirLength = this->dirPath.size();
+  // Rows of the previous update are overwritten to keep their path buffers
+  if (this->cgroupsRead == this->cgroups.size()) this->cgroups.emplace_back();
+  CgroupInfo& info = this->cgroups[this->cgroupsRead++];
+  unsigned long usageUsec, readBytes = 0, writeBytes = 0;
+  std::string_view text;
+
+  info.path.assign(path.empty() ? "/" : path);
+
+  this->dirPath += "/cpu.stat";
+  usageUsec = keyedValue(readProcFile(this->dirPath.c_str(), this->readBuffer),
+                         "usage_usec");
+
+  // Absent on the root cgroup
+  this->dirPath.resize(dirLength);
+  this->dirPath += "/memory.current";
+  text = readProcFile(this->dirPath.c_str(), this->readBuffer);
+  info.memCurrentKB = 0;
+  if (nextUnsigned(text, info.memCurrentKB)) info.memCurrentKB /= 1024;
+
+  this->dirPath.resize(dirLength);
+  this->dirPath += "/memory.stat";
+  text = readProcFile(this->dirPath.c_str(), this->readBuffer);
+  info.memAnonKB = keyedValue(text, "anon") / 1024;
+  info.memFileKB = keyedValue(text, "file") / 1024;
+
+  // One line per device: "MAJ:MIN rbytes=N wbytes=N rios=N ..."
+  this->dirPath.resize(dirLength);
+  this->dirPath += "/io.stat";
+  text = readProcFile(this->dirPath.c_str(), this->readBuffer);
+  while (!text.empty()) {
+    std::string_view line = nextLine(text);
+
+    nextToken(line);
+    while (!line.empty()) {
+      std::string_view field = nextToken(line);
+      size_t eq = field.find('=');
+
+      if (eq == std::string_view::npos) continue;
+
+      std::string_view key = field.substr(0, eq);
+      std::string_view number = field.substr(eq + 1);
+      unsigned long value = 0;
+
+      if (!nextUnsigned(number, value)) continue;
+      if (key == "rbytes") {
+        readBytes += value;
+      } else if (key == "wbytes") {
+        writeBytes += value;
+      }
+    }
+  }
+  this->dirPath.resize(dirLength);
+
+  auto [it, inserted] = this->counters.try_emplace(info.path);
+  Counters& prev = it->second;
+  double seconds = std::chrono::duration<double>(now - prev.readAt).count();
+
+  // Counters that went backwards belong to a cgroup that was recreated
+  if (!inserted && seconds > 0 && usageUsec >= prev.usageUsec &&
+      readBytes >= prev.readBytes && writeBytes >= prev.writeBytes) {
+    info.cpuUsed = (usageUsec - prev.usageUsec) / (seconds * 1e6) * 100.0;
+    info.readBytesPerSec = (readBytes - prev.readBytes) / seconds;
+    info.writeBytesPerSec = (writeBytes - prev.writeBytes) / seconds;
+  } else {
+    info.cpuUsed = 0.0;
+    info.readBytesPerSec = 0.0;
+    info.writeBytesPerSec = 0.0;
+  }
+  prev.usageUsec = usageUsec;
+  prev.readBytes = readBytes;
+  prev.writeBytes = writeBytes;
+  prev.readAt = now;
+  prev.seenUpdate = this->updates;
+}
+
+void CgroupTable::walk(size_t rootLength) {
+  auto now = std::chrono::steady_clock::now();
+  std::string_view path(this->dirPath);
+  size_t index = this->cgroupsRead;
+
+  readCgroup(path.substr(rootLength), now);
+  if (this->leaves.size() < this->cgroupsRead) {
+    this->leaves.resize(this->cgroupsRead);
+  }
+  this->leaves[index] = true;
+
+  DIR* dir = ::opendir(this->dirPath.c_str());
+
+  if (!dir) return;
+  SelfStats::instance().countOpen();
+
+  size_t dirLength = this->dirPath.size();
+
+  // Every subdirectory is a child cgroup; the files are its interface
+  while (struct dirent* entry = ::readdir(dir)) {
+    if (entry->d_type != DT_DIR || entry->d_name[0] == '.') continue;
+    this->leaves[index] = false;
+    this->dirPath += '/';
+    this->dirPath += entry->d_name;
+    walk(rootLength);
+    this->dirPath.resize(dirLength);
+  }
+  ::closedir(dir);
+}
+
+void CgroupTable::update() {
+  PhaseTimer timer(Phase::Cgroups);
+
+  this->updates++;
+  this->cgroupsRead = 0;
+  this->dirPath = this->root;
+  walk(this->root.size());
+  this->cgroups.resize(this->cgroupsRead);
+  this->leaves.resize(this->cgroupsRead);
+
+  // Forget cgroups that were removed
+  std::erase_if(this->counters, [this](const auto& entry) {
+    return entry.second.seenUpdate != this->updates;
+  });
+}
+
+std::vector<CgroupInfo> CgroupTable::getTopCgroups(size_t n, SortKey key) {
+  auto better = [this, key](size_t a, size_t b) {
+    const CgroupInfo& x = this->cgroups[a];
+    const CgroupInfo& y = this->cgroups[b];
+
+    switch (key) {
+      case SortKey::Cpu:
+        if (x.cpuUsed != y.cpuUsed) return x.cpuUsed > y.cpuUsed;
+        break;
+      case SortKey::Memory:
+        if (x.memCurrentKB != y.memCurrentKB) {
+          return x.memCurrentKB > y.memCurrentKB;
+        }
+        break;
+      case SortKey::Io: {
+        double ioX = x.readBytesPerSec + x.writeBytesPerSec;
+        double ioY = y.readBytesPerSec + y.writeBytesPerSec;
+
+        if (ioX != ioY) return ioX > ioY;
+        break;
+      }
+      case SortKey::Pid:
+        break;
+    }
+    return x.path < y.path;
+  };
+  std::vector<CgroupInfo> res;
+
+  // The root is always row 0
+  this->topRows.clear();
+  for (size_t i = 1; i < this->cgroups.size(); i++) {
+    if (this->leaves[i]) this->topRows.push_back(i);
+  }
+
+  n = std::min(n, this->topRows.size());
+  std::nth_element(this->topRows.begin(), this->topRows.begin() + n,
+                   this->topRows.end(), better);
+  this->topRows.resize(n);
+  std::sort(this->topRows.begin(), this->topRows.end(), better);
+
+  res.reserve(n);
+  for (size_t row : this->topRows) res.push_back(this->cgroups[row]);
+
+  return res;
+}
+
+std::string CgroupTable::normalizePath(std::string_view path) {
+  while (path.starts_with('/')) path.remove_prefix(1);
+  while (path.ends_with('/')) path.remove_suffix(1);
+
+  return "/" + std::string(path);
+}
+
+bool CgroupTable::readProcs(const std::string& path, std::vector<int>& pids) {
+  std::string normalized = normalizePath(path);
+  std::string file = this->root + (normalized == "/" ? "" : normalized) +
+                     "/cgroup.procs";
+  std::string_view text = readProcFile(file.c_str(), this->readBuffer);
+  unsigned long pid;
+
+  pids.clear();
+  if (text.empty()) return ::access(file.c_str(), R_OK) == 0;
+  while (nextUnsigned(text, pid)) pids.push_back(static_cast<int>(pid));
+
+  return true;
+}
@@ -0,0 +1,158 @@
+#include "Collector.h"
+
+Collector::Collector(SystemInfo& sysInfo, ProcessTable& procTable,
+                     std::chrono::milliseconds interval, size_t procNum,
+                     SortKey sortKey)
+    : sysInfo(sysInfo),
+      procTable(procTable),
+      interval(interval),
+      procNum(procNum),
+      sortKey(sortKey) {}
+
+Collector::~Collector() { stop(); }
+
+void Collector::start() { scheduler = std::thread(&Collector::run, this); }
+
+void Collector::stop() {
+  {
+    std::lock_guard<std::mutex> lock(stopMutex);
+    stopping = true;
+  }
+  stopCv.notify_all();
+  if (scheduler.joinable()) scheduler.join();
+}
+
+unsigned long Collector::waitForTick(unsigned long lastTick,
+                                     std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(tickMutex);
+
+  tickCv.wait_for(lock, timeout, [&] {
+    return publishedTick.load(std::memory_order_acquire) != lastTick;
+  });
+  return publishedTick.load(std::memory_order_acquire);
+}
+
+const Snapshot& Collector::latest() {
+  if (middle.load(std::memory_order_acquire) & freshBit) {
+    front = middle.exchange(front, std::memory_order_acq_rel) & ~freshBit;
+  }
+  return slots[front];
+}
+
+void Collector::publish() {
+  unsigned long tick = slots[back].tick;
+
+  back = middle.exchange(back | freshBit, std::memory_order_acq_rel) &
+         ~freshBit;
+  {
+    std::lock_guard<std::mutex> lock(tickMutex);
+    publishedTick.store(tick, std::memory_order_release);
+  }
+  tickCv.notify_all();
+}
+
+void Collector::expandCgroup(const std::string& path) {
+  std::lock_guard<std::mutex> lock(cgroupMutex);
+
+  expandedCgroup = path;
+}
+
+std::vector<ProcessInfo> Collector::topProcesses(bool tree) {
+  return tree ? procTable.getProcessTree(procNum, sortKey)
+              : procTable.getTopProcesses(procNum, sortKey);
+}
+
+void Collector::collectCgroups(Snapshot& snapshot) {
+  cgroupTable->update();
+  snapshot.cgroupCount = cgroupTable->cgroupCount();
+  snapshot.cgroups = cgroupTable->getTopCgroups(procNum, sortKey);
+  {
+    std::lock_guard<std::mutex> lock(cgroupMutex);
+
+    snapshot.expandedCgroup = expandedCgroup;
+  }
+
+  // Nothing but the expanded cgroup's members is read from /proc
+  if (snapshot.expandedCgroup.empty() ||
+      !cgroupTable->readProcs(snapshot.expandedCgroup, cgroupPids)) {
+    cgroupPids.clear();
+  }
+  procTable.limitToPids(cgroupPids);
+  procTable.update();
+}
+
+void Collector::collect(Snapshot& snapshot) {
+  auto start = std::chrono::steady_clock::now();
+
+  snapshot.tree = treeOrder.load(std::memory_order_relaxed);
+  collectPool.run(3, 1, [&](unsigned, size_t job, size_t) {
+    switch (job) {
+      case 0:
+        snapshot.cpu = sysInfo.getCpuUsage();
+        break;
+      case 1:
+        snapshot.mem = sysInfo.getMemoryUsage();
+        if (diskStats) sysInfo.getDiskUsage(snapshot.disks);
+        break;
+      case 2:
+        // The tree is kept up to date by update() once enabled
+        procTable.enableTree(snapshot.tree);
+        if (cgroupTable) {
+          collectCgroups(snapshot);
+        } else {
+          procTable.update();
+        }
+        snapshot.processCount = procTable.processCount();
+        snapshot.events = procTable.processEvents();
+        snapshot.processes = topProcesses(snapshot.tree);
+        procTable.getThreads(snapshot.processes,
+                             threadProcs.load(std::memory_order_relaxed),
+                             snapshot.threads);
+        break;
+    }
+  });
+
+  snapshot.collectTime = std::chrono::steady_clock::now() - start;
+  if (selfStats) SelfStats::instance().sample(snapshot.self);
+}
+
+void Collector::run() {
+  auto deadline = std::chrono::steady_clock::now();
+  auto wallDeadline = std::chrono::system_clock::now();
+  unsigned long tick = 0;
+  unsigned long missed = 0;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(stopMutex);
+      if (stopCv.wait_until(lock, deadline, [this] { return stopping; })) {
+        return;
+      }
+    }
+
+    Snapshot& snapshot = slots[back];
+
+    snapshot.tick = ++tick;
+    snapshot.timestamp = wallDeadline;
+    collect(snapshot);
+
+    // Deadlines stay on the original grid: if collection overran one or more
+    // of them, skip to the next one still ahead and count the rest as missed
+    deadline += interval;
+    wallDeadline += interval;
+
+    auto now = std::chrono::steady_clock::now();
+
+    if (now >= deadline) {
+      auto behind = (now - deadline) / interval + 1;
+
+      missed += behind;
+      deadline += behind * interval;
+      wallDeadline += behind * interval;
+    }
+
+    snapshot.missedDeadlines = missed;
+    for (const auto& consumer : consumers) consumer(snapshot);
+    publish();
+  }
+}
@@ -0,0 +1,284 @@
+#include "Display.h"
+
+#include <algorithm>
+
+// Column widths of the process table
+constexpr int pidWidth = 8;
+constexpr int nameWidth = 40;
+constexpr int stateWidth = 11;
+constexpr int cpuWidth = 7;
+constexpr int memWidth = 10;
+// Indentation of tree levels, at most half of the name column
+constexpr std::string_view treeIndent = "                    ";
+// Short-lived processes listed under the process events
+constexpr size_t shortLivedLines = 5;
+
+static void drawSystemInfo(Renderer& renderer, const Snapshot& snapshot) {
+  const CpuUsage& cpu = snapshot.cpu;
+  const MemoryUsage& mem = snapshot.mem;
+
+  renderer.text("CPU load:").endLine();
+  renderer.text("Total usage = ").number(cpu.totalUsage, 2).text("%").endLine();
+  for (size_t i = 0; i < cpu.perCoreUsage.size(); i++) {
+    renderer.text("Core ")
+        .number(i)
+        .text(" usage = ")
+        .number(cpu.perCoreUsage[i], 2)
+        .text("%")
+        .endLine();
+  }
+
+  renderer.text("Total RAM: ").number(mem.totalKB).text(" kB").endLine();
+  renderer.text("Used RAM: ").number(mem.usedKB).text(" kB").endLine();
+  renderer.text("Available RAM: ")
+      .number(mem.availableKB)
+      .text(" kB")
+      .endLine();
+  renderer.text("RAM usage: ").number(mem.usedPercent, 2).text("%").endLine();
+  renderer.text("Buffers/cache: ")
+      .number(mem.buffersKB + mem.cachedKB + mem.sReclaimableKB)
+      .text(" kB (shared ")
+      .number(mem.shmemKB)
+      .text(" kB)")
+      .endLine();
+  renderer.text("Swap: ")
+      .number(mem.swapUsedKB)
+      .text(" / ")
+      .number(mem.swapTotalKB)
+      .text(" kB")
+      .endLine();
+
+  for (const DiskUsage& disk : snapshot.disks) {
+    renderer.text("Disk ")
+        .text(disk.name)
+        .text(": ")
+        .number(disk.readsPerSec, 0)
+        .text(" r/s ")
+        .number(disk.writesPerSec, 0)
+        .text(" w/s  read ")
+        .number(disk.readBytesPerSec / 1024, 0)
+        .text(" kB/s  write ")
+        .number(disk.writeBytesPerSec / 1024, 0)
+        .text(" kB/s  util ")
+        .number(disk.utilization, 1)
+        .text("%")
+        .endLine();
+  }
+
+  if (snapshot.cgroups.empty()) {
+    renderer.text("Active processes: ")
+        .number(snapshot.processCount)
+        .endLine();
+  }
+  if (snapshot.events.tracked) {
+    renderer.text("Process events: ")
+        .number(snapshot.events.started)
+        .text(" started, ")
+        .number(snapshot.events.exited)
+        .text(" exited, ")
+        .number(snapshot.events.shortLived)
+        .text(" short-lived")
+        .endLine();
+
+    const auto& shortLived = snapshot.events.shortLivedProcesses;
+    size_t listed = std::min(shortLived.size(), shortLivedLines);
+
+    for (size_t i = 0; i < listed; i++) {
+      const ShortLivedProcess& proc = shortLived[i];
+
+      renderer.text("  ")
+          .number(static_cast<unsigned long>(proc.pid))
+          .text(" ")
+          .text(proc.name.empty() ? "?" : proc.name)
+          .text(" (parent ")
+          .number(static_cast<unsigned long>(proc.ppid))
+          .text(") exit ")
+          .number(static_cast<unsigned long>(proc.exitCode))
+          .text(" after ")
+          .number(proc.lifetime.count() / 1000.0, 1)
+          .text(" ms")
+          .endLine();
+    }
+    if (snapshot.events.shortLived > listed) {
+      renderer.text("  ... and ")
+          .number(snapshot.events.shortLived - listed)
+          .text(" more")
+          .endLine();
+    }
+  }
+  renderer.text("Missed deadlines: ")
+      .number(snapshot.missedDeadlines)
+      .endLine();
+  renderer.endLine();
+}
+
+// Lines taken by drawSelfStats()
+constexpr int selfStatsLines = 3;
+
+static void drawSelfStats(Renderer& renderer, const SelfSample& self) {
+  renderer.endLine();
+  renderer.text("mini-top: CPU ")
+      .number(self.cpuPercent, 1)
+      .text("%  RSS ")
+      .number(self.rssKB)
+      .text(" kB  files/tick ")
+      .number(self.filesOpened)
+      .text("  bytes/tick ")
+      .number(self.bytesRead)
+      .endLine();
+  renderer.text("latency p50/p99 us:");
+  for (size_t i = 0; i < phaseCount; i++) {
+    renderer.text("  ")
+        .text(phaseName(static_cast<Phase>(i)))
+        .text(" ")
+        .number(self.phases[i].p50Ns / 1000.0, 0)
+        .text("/")
+        .number(self.phases[i].p99Ns / 1000.0, 0);
+  }
+  renderer.endLine();
+}
+
+// Columns of the cgroup table
+constexpr int pathWidth = 48;
+
+static void drawCgroupTable(Renderer& renderer, const Snapshot& snapshot,
+                            const DisplayOptions& options) {
+  renderer.text("Cgroups: ").number(snapshot.cgroupCount).endLine();
+  renderer.column("  Cgroup", pathWidth)
+      .column("% CPU", cpuWidth)
+      .column("Mem KB", memWidth)
+      .column("Anon KB", memWidth)
+      .column("File KB", memWidth)
+      .column("Rd KB/s", memWidth)
+      .column("Wr KB/s", memWidth)
+      .endLine();
+
+  // Leave at least half of the window to the expanded cgroup's processes
+  int footerLines = options.showSelfStats ? selfStatsLines : 0;
+  int budget = renderer.rows() - renderer.lineCount() - footerLines;
+  size_t rowsLeft = std::max(
+      snapshot.expandedCgroup.empty() ? budget : budget / 2, 0);
+  size_t count = std::min(snapshot.cgroups.size(), options.maxProcesses);
+
+  for (size_t i = 0; i < count && rowsLeft > 0; i++, rowsLeft--) {
+    const CgroupInfo& info = snapshot.cgroups[i];
+    const char* marker = info.path == options.selectedCgroup ? "> " : "  ";
+
+    renderer.text(marker)
+        .column(info.path, pathWidth - 2)
+        .column(info.cpuUsed, 2, cpuWidth)
+        .column(info.memCurrentKB, memWidth)
+        .column(info.memAnonKB, memWidth)
+        .column(info.memFileKB, memWidth)
+        .column(info.readBytesPerSec / 1024, 0, memWidth)
+        .column(info.writeBytesPerSec / 1024, 0, memWidth)
+        .endLine();
+  }
+  renderer.endLine();
+
+  if (!snapshot.expandedCgroup.empty()) {
+    renderer.text("Processes in ").text(snapshot.expandedCgroup).endLine();
+  }
+}
+
+static void drawProcessTable(Renderer& renderer, const Snapshot& snapshot,
+                             const DisplayOptions& options) {
+  renderer.column("PID", pidWidth)
+      .column("Name", nameWidth)
+      .column("State", stateWidth)
+      .column("% CPU", cpuWidth)
+      .column("RAM KB", memWidth);
+  if (snapshot.tree) {
+    renderer.column("Tree %", cpuWidth).column("Tree KB", memWidth);
+  }
+  if (options.showSwap) renderer.column("Swap KB", memWidth);
+  if (options.showPss) {
+    renderer.column("PSS KB", memWidth).column("USS KB", memWidth);
+  }
+  if (options.showIo) {
+    renderer.column("Rd KB/s", memWidth).column("Wr KB/s", memWidth);
+  }
+  renderer.endLine();
+
+  // Only as many rows as the window has left
+  int footerLines = options.showSelfStats ? selfStatsLines : 0;
+  size_t rowsLeft =
+      std::max(renderer.rows() - renderer.lineCount() - footerLines, 0);
+  size_t count = std::min(snapshot.processes.size(), options.maxProcesses);
+  // Threads are grouped by process in the same order as the processes
+  size_t thread = 0;
+
+  for (size_t i = 0; i < count && rowsLeft > 0; i++, rowsLeft--) {
+    const ProcessInfo& info = snapshot.processes[i];
+    // Two spaces per tree level, leaving at least half of the name
+    int indent =
+        snapshot.tree ? std::min<int>(2 * info.depth, nameWidth / 2) : 0;
+
+    renderer.column(static_cast<unsigned long>(info.pid), pidWidth)
+        .text(treeIndent.substr(0, indent))
+        .column(info.name, nameWidth - indent)
+        .column(processStateName(info.state), stateWidth);
+    // A rate carried over from an earlier read is marked as estimated
+    if (info.cpuEstimated) {
+      renderer.text("~").column(info.cpuUsed, 2, cpuWidth - 1);
+    } else {
+      renderer.column(info.cpuUsed, 2, cpuWidth);
+    }
+    renderer.column(info.memUsedKB, memWidth);
+    if (snapshot.tree) {
+      renderer.column(info.subtreeCpuUsed, 2, cpuWidth)
+          .column(info.subtreeMemKB, memWidth);
+    }
+    if (options.showSwap) renderer.column(info.swapKB, memWidth);
+    if (options.showPss) {
+      renderer.column(info.pssKB, memWidth).column(info.ussKB, memWidth);
+    }
+    if (options.showIo) {
+      renderer.column(info.readBytesPerSec / 1024, 0, memWidth)
+          .column(info.writeBytesPerSec / 1024, 0, memWidth);
+    }
+    renderer.endLine();
+
+    // Threads one level below their process
+    indent = std::min<int>(indent + 2, nameWidth / 2);
+    for (; thread < snapshot.threads.size() &&
+           snapshot.threads[thread].pid == info.pid && rowsLeft > 1;
+         thread++, rowsLeft--) {
+      const ThreadInfo& task = snapshot.threads[thread];
+
+      renderer.column(static_cast<unsigned long>(task.tid), pidWidth)
+          .text(treeIndent.substr(0, indent))
+          .column(task.name, nameWidth - indent)
+          .column(processStateName(task.state), stateWidth)
+          .column(task.cpuUsed, 2, cpuWidth)
+          .endLine();
+    }
+    // Skip the threads that did not fit
+    while (thread < snapshot.threads.size() &&
+           snapshot.threads[thread].pid == info.pid) {
+      thread++;
+    }
+  }
+}
+
+void drawSnapshot(Renderer& renderer, const Snapshot& snapshot,
+                  const DisplayOptions& options) {
+  PhaseTimer timer(Phase::Render);
+
+  renderer.beginFrame();
+  if (!options.statusLine.empty()) {
+    renderer.text(options.statusLine).endLine();
+  }
+  drawSystemInfo(renderer, snapshot);
+  if (options.showCgroups) {
+    drawCgroupTable(renderer, snapshot, options);
+    // Only the expanded cgroup has processes to list
+    if (!snapshot.expandedCgroup.empty()) {
+      drawProcessTable(renderer, snapshot, options);
+    }
+  } else {
+    drawProcessTable(renderer, snapshot, options);
+  }
+  if (options.showSelfStats) drawSelfStats(renderer, snapshot.self);
+  renderer.endFrame();
+}
@@ -0,0 +1,275 @@
+#include "ProcConnector.h"
+
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include "ProcReader.h"
+
+// Receive buffer requested from the kernel, so that a burst of forks between
+// two ticks does not overflow the socket
+constexpr int socketBufferSize = 4 * 1024 * 1024;
+// How long open() waits for the kernel to acknowledge the subscription
+constexpr int ackTimeoutMs = 200;
+// Names read per drain(), so that a fork storm does not turn into as many
+// opens of /proc on the sampling thread
+constexpr size_t maxNameReads = 256;
+
+ProcConnector::~ProcConnector() {
+  if (fd >= 0) ::close(fd);
+}
+
+// Acknowledgement number of the subscription request; the kernel answers
+// with this plus one
+constexpr uint32_t listenAck = 1;
+
+// Send PROC_CN_MCAST_LISTEN or PROC_CN_MCAST_IGNORE, tagged with seq
+static bool sendMcastOp(int fd, proc_cn_mcast_op op, uint32_t seq) {
+  alignas(nlmsghdr) char message[NLMSG_SPACE(sizeof(cn_msg) + sizeof(op))] =
+      {};
+  auto* header = reinterpret_cast<nlmsghdr*>(message);
+  auto* msg = static_cast<cn_msg*>(NLMSG_DATA(header));
+
+  header->nlmsg_len = NLMSG_LENGTH(sizeof(cn_msg) + sizeof(op));
+  header->nlmsg_type = NLMSG_DONE;
+  header->nlmsg_pid = 0;
+  msg->id.idx = CN_IDX_PROC;
+  msg->id.val = CN_VAL_PROC;
+  msg->seq = seq;
+  msg->ack = listenAck;
+  msg->len = sizeof(op);
+  std::memcpy(msg->data, &op, sizeof(op));
+
+  return ::send(fd, message, header->nlmsg_len, 0) ==
+         static_cast<ssize_t>(header->nlmsg_len);
+}
+
+// Wait for the kernel's answer to the request tagged with seq. Returns the
+// error it reports (0 if the subscription was accepted), or ETIMEDOUT.
+static int receiveAck(int fd, uint32_t seq, std::vector<char>& buffer) {
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::milliseconds(ackTimeoutMs);
+
+  while (true) {
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    pollfd pfd = {fd, POLLIN, 0};
+
+    if (remaining.count() <= 0 || ::poll(&pfd, 1, remaining.count()) != 1) {
+      return ETIMEDOUT;
+    }
+
+    sockaddr_nl from = {};
+    socklen_t fromLen = sizeof(from);
+    ssize_t n = ::recvfrom(fd, buffer.data(), buffer.size(), 0,
+                           reinterpret_cast<sockaddr*>(&from), &fromLen);
+
+    if (n < 0 || from.nl_pid != 0) continue;
+
+    auto* header = reinterpret_cast<nlmsghdr*>(buffer.data());
+
+    // Events that arrive first are dropped: the caller lists /proc after
+    // subscribing anyway
+    for (size_t left = n; NLMSG_OK(header, left);
+         header = NLMSG_NEXT(header, left)) {
+      if (header->nlmsg_type != NLMSG_DONE) continue;
+
+      auto* msg = static_cast<cn_msg*>(NLMSG_DATA(header));
+      auto* event = reinterpret_cast<proc_event*>(msg->data);
+
+      if (msg->id.idx == CN_IDX_PROC && msg->id.val == CN_VAL_PROC &&
+          msg->seq == seq && msg->ack == listenAck + 1 &&
+          event->what == proc_event::PROC_EVENT_NONE) {
+        return event->event_data.ack.err;
+      }
+    }
+  }
+}
+
+bool ProcConnector::open(std::string& error) {
+  sockaddr_nl addr = {};
+
+  fd = ::socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                NETLINK_CONNECTOR);
+  if (fd < 0) {
+    error = std::string("netlink socket: ") + strerror(errno);
+    return false;
+  }
+
+  // The forced size ignores rmem_max but needs CAP_NET_ADMIN, which the
+  // subscription needs anyway
+  if (::setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &socketBufferSize,
+                   sizeof(socketBufferSize)) != 0) {
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &socketBufferSize,
+                 sizeof(socketBufferSize));
+  }
+
+  // The acknowledgement is multicast to every listener, so it is told apart
+  // from other programs' by its sequence number
+  uint32_t seq = ::getpid();
+
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = CN_IDX_PROC;
+  if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+      !sendMcastOp(fd, PROC_CN_MCAST_LISTEN, seq)) {
+    error = std::string("proc connector: ") + strerror(errno);
+    ::close(fd);
+    fd = -1;
+    return false;
+  }
+
+  // The kernel acknowledges the request with its outcome, e.g. EPERM without
+  // CAP_NET_ADMIN or outside the initial namespaces. It only sends the
+  // acknowledgement while someone is subscribed, so a refusal with no other
+  // listener shows up as a timeout instead.
+  buffer.resize(64 * 1024);
+
+  int err = receiveAck(fd, seq, buffer);
+
+  if (err != 0) {
+    error = err == ETIMEDOUT
+                ? "proc connector: subscription not acknowledged"
+                : std::string("proc connector: subscription refused: ") +
+                      strerror(err);
+    ::close(fd);
+    fd = -1;
+    return false;
+  }
+
+  return true;
+}
+
+void ProcConnector::reset(const std::vector<int>& pids) {
+  livePids.clear();
+  livePids.insert(pids.begin(), pids.end());
+}
+
+// Read the name of pid into name, if it still exists
+bool ProcConnector::readName(int pid, std::string& name) {
+  char path[64];
+
+  if (nameReads >= maxNameReads) return false;
+  nameReads++;
+  snprintf(path, sizeof(path), "/proc/%d/comm", pid);
+
+  std::string_view comm = readProcFile(path, nameBuffer);
+
+  if (comm.empty()) return false;
+  name.assign(nextLine(comm));
+  return true;
+}
+
+bool ProcConnector::drain(ProcessEvents& events) {
+  bool complete = true;
+
+  newPids.clear();
+  nameReads = 0;
+  events.tracked = true;
+
+  while (true) {
+    sockaddr_nl from = {};
+    socklen_t fromLen = sizeof(from);
+    ssize_t n = ::recvfrom(fd, buffer.data(), buffer.size(), 0,
+                           reinterpret_cast<sockaddr*>(&from), &fromLen);
+
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      // ENOBUFS: the socket overflowed and events were lost. The queue
+      // keeps going after the error, so drain the rest anyway.
+      if (errno == ENOBUFS) {
+        complete = false;
+        continue;
+      }
+      break;
+    }
+    // Only the kernel may send events
+    if (from.nl_pid != 0) continue;
+
+    auto* header = reinterpret_cast<nlmsghdr*>(buffer.data());
+
+    for (size_t left = n; NLMSG_OK(header, left);
+         header = NLMSG_NEXT(header, left)) {
+      if (header->nlmsg_type != NLMSG_DONE) continue;
+
+      auto* msg = static_cast<cn_msg*>(NLMSG_DATA(header));
+
+      if (msg->id.idx != CN_IDX_PROC || msg->id.val != CN_VAL_PROC) continue;
+
+      auto* event = reinterpret_cast<proc_event*>(msg->data);
+
+      switch (event->what) {
+        case proc_event::PROC_EVENT_FORK: {
+          const auto& fork = event->event_data.fork;
+
+          // New threads report their own PID with their process' TGID
+          if (fork.child_pid != fork.child_tgid) break;
+          livePids.insert(fork.child_tgid);
+
+          Forked& forked = newPids[fork.child_tgid];
+
+          forked.ppid = fork.parent_tgid;
+          forked.forkNs = event->timestamp_ns;
+          forked.name.clear();
+          // Events wait for the next tick, by when a short-lived child is
+          // usually gone; it then keeps its parent's name, which fork copies
+          if (!readName(fork.child_tgid, forked.name)) {
+            readName(fork.parent_tgid, forked.name);
+          }
+          events.started++;
+          break;
+        }
+        case proc_event::PROC_EVENT_EXEC: {
+          const auto& exec = event->event_data.exec;
+          auto it = newPids.find(exec.process_tgid);
+
+          // Only the names of new processes are kept; a tick re-reads the
+          // others
+          if (it != newPids.end()) readName(exec.process_tgid, it->second.name);
+          break;
+        }
+        case proc_event::PROC_EVENT_EXIT: {
+          const auto& exit = event->event_data.exit;
+
+          if (exit.process_pid != exit.process_tgid) break;
+          livePids.erase(exit.process_tgid);
+          events.exited++;
+
+          auto it = newPids.find(exit.process_tgid);
+
+          if (it == newPids.end()) break;
+          events.shortLived++;
+          if (events.shortLivedProcesses.size() <
+              ProcessEvents::maxShortLived) {
+            int status = exit.exit_code;
+
+            events.shortLivedProcesses.push_back({
+                .pid = exit.process_tgid,
+                .ppid = it->second.ppid,
+                .name = std::move(it->second.name),
+                .exitCode = WIFSIGNALED(status) ? 128 + WTERMSIG(status)
+                                                : WEXITSTATUS(status),
+                .lifetime = std::chrono::microseconds(
+                    (event->timestamp_ns - it->second.forkNs) / 1000),
+            });
+          }
+          newPids.erase(it);
+          break;
+        }
+        default:
+          // The rest change nothing that a tick does not re-read
+          break;
+      }
+    }
+  }
+
+  return complete;
+}
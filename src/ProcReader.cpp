@@ -0,0 +1,149 @@
+#include "ProcReader.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <charconv>
+#include <utility>
+
+#include "SelfStats.h"
+
+ProcFile::ProcFile(const std::string& path)
+    : fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC)),
+      buffer(procReadBufferSize) {}
+
+ProcFile::~ProcFile() {
+  if (fd >= 0) ::close(fd);
+}
+
+ProcFile::ProcFile(ProcFile&& other) noexcept
+    : fd(std::exchange(other.fd, -1)), buffer(std::move(other.buffer)) {}
+
+ProcFile& ProcFile::operator=(ProcFile&& other) noexcept {
+  if (this != &other) {
+    if (fd >= 0) ::close(fd);
+    fd = std::exchange(other.fd, -1);
+    buffer = std::move(other.buffer);
+  }
+  return *this;
+}
+
+// Read from offset 0 until EOF, doubling the buffer if the file did not fit.
+// /proc files are generated on read, so a partial read must be retried from
+// the start rather than continued.
+static std::string_view preadAll(int fd, std::vector<char>& buffer) {
+  if (buffer.empty()) buffer.resize(procReadBufferSize);
+
+  while (true) {
+    ssize_t total = 0;
+    ssize_t n;
+
+    while ((n = ::pread(fd, buffer.data() + total, buffer.size() - total,
+                        total)) > 0) {
+      total += n;
+      if (static_cast<size_t>(total) == buffer.size()) break;
+    }
+    if (n < 0) return {};
+    if (static_cast<size_t>(total) < buffer.size()) {
+      return std::string_view(buffer.data(), total);
+    }
+    buffer.resize(buffer.size() * 2);
+  }
+}
+
+std::string_view ProcFile::read() {
+  if (fd < 0) return {};
+
+  std::string_view result = preadAll(fd, buffer);
+
+  SelfStats::instance().countRead(result.size());
+
+  return result;
+}
+
+std::string_view readProcFile(const char* path, std::vector<char>& buffer) {
+  int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+
+  SelfStats::instance().countOpen();
+  if (fd < 0) return {};
+
+  std::string_view result = preadAll(fd, buffer);
+
+  ::close(fd);
+  SelfStats::instance().countRead(result.size());
+
+  return result;
+}
+
+std::string_view nextLine(std::string_view& text) {
+  size_t end = text.find('\n');
+  std::string_view line = text.substr(0, end);
+
+  text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+
+  return line;
+}
+
+static bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n';
+}
+
+std::string_view nextToken(std::string_view& text) {
+  size_t begin = 0;
+
+  while (begin < text.size() && isSpace(text[begin])) begin++;
+
+  size_t end = begin;
+
+  while (end < text.size() && !isSpace(text[end])) end++;
+
+  std::string_view token = text.substr(begin, end - begin);
+
+  text.remove_prefix(end);
+
+  return token;
+}
+
+bool nextUnsigned(std::string_view& text, unsigned long& value) {
+  std::string_view token = nextToken(text);
+  auto [ptr, ec] =
+      std::from_chars(token.data(), token.data() + token.size(), value);
+
+  return ec == std::errc() && ptr == token.data() + token.size();
+}
+
+bool parseProcStat(std::string_view text, ProcStat& stat) {
+  size_t open = text.find('(');
+  size_t close = text.rfind(')');
+
+  if (open == std::string_view::npos || close == std::string_view::npos ||
+      close < open) {
+    return false;
+  }
+
+  stat.comm = text.substr(open + 1, close - open - 1);
+  text.remove_prefix(close + 1);
+
+  std::string_view state = nextToken(text);
+  unsigned long ppid = 0;
+  unsigned long unused;
+
+  if (state.empty() || !nextUnsigned(text, ppid)) return false;
+  stat.state = state.front();
+  stat.ppid = static_cast<int>(ppid);
+
+  // Skip fields 5 (pgrp) through 13 (cmajflt). tty_nr and tpgid may be
+  // negative, so they are skipped as plain tokens.
+  for (int field = 5; field <= 13; field++) nextToken(text);
+
+  bool ok = nextUnsigned(text, stat.utime) && nextUnsigned(text, stat.stime);
+
+  // Skip fields 16 (cutime) through 19 (nice)
+  for (int field = 16; field <= 19; field++) nextToken(text);
+
+  ok = ok && nextUnsigned(text, stat.numThreads) &&
+       nextUnsigned(text, unused) && nextUnsigned(text, stat.startTime) &&
+       nextUnsigned(text, unused) && nextUnsigned(text, stat.rssPages);
+
+  return ok;
+}
@@ -0,0 +1,185 @@
+#include "ProcessStore.h"
+
+#include <algorithm>
+
+void ProcessStore::beginTick() { tick++; }
+
+size_t ProcessStore::upsert(int pid) {
+  auto [it, inserted] = index.try_emplace(pid, pids.size());
+
+  if (inserted) {
+    pids.push_back(pid);
+    names.emplace_back();
+    states.push_back(ProcessState::Unknown);
+    cpuUsed.push_back(0.0);
+    memUsedKB.push_back(0);
+    ppids.push_back(0);
+    threads.push_back(0);
+    startTimes.push_back(0);
+    swapKB.push_back(0);
+    pssKB.push_back(0);
+    ussKB.push_back(0);
+    pssRssKB.push_back(pssUnread);
+    ioReadBytes.push_back(0);
+    ioWriteBytes.push_back(0);
+    ioReadAt.emplace_back();
+    readBytesPerSec.push_back(0.0);
+    writeBytesPerSec.push_back(0.0);
+    cpuTicks.push_back(0);
+    readTotals.push_back(0);
+    nextReads.push_back(0);
+    idleReads.push_back(0);
+    seenTick.push_back(tick);
+  }
+  seenTick[it->second] = tick;
+
+  return it->second;
+}
+
+void ProcessStore::reset(size_t i) {
+  names[i].clear();
+  states[i] = ProcessState::Unknown;
+  cpuUsed[i] = 0.0;
+  memUsedKB[i] = 0;
+  ppids[i] = 0;
+  threads[i] = 0;
+  startTimes[i] = 0;
+  swapKB[i] = 0;
+  pssKB[i] = 0;
+  ussKB[i] = 0;
+  pssRssKB[i] = pssUnread;
+  ioReadBytes[i] = 0;
+  ioWriteBytes[i] = 0;
+  ioReadAt[i] = {};
+  readBytesPerSec[i] = 0.0;
+  writeBytesPerSec[i] = 0.0;
+  cpuTicks[i] = 0;
+  readTotals[i] = 0;
+  nextReads[i] = 0;
+  idleReads[i] = 0;
+}
+
+size_t ProcessStore::find(int pid) const {
+  auto it = index.find(pid);
+
+  return it == index.end() ? npos : it->second;
+}
+
+void ProcessStore::removeRow(size_t i) {
+  size_t last = pids.size() - 1;
+
+  index.erase(pids[i]);
+  if (i != last) {
+    pids[i] = pids[last];
+    names[i].swap(names[last]);
+    states[i] = states[last];
+    cpuUsed[i] = cpuUsed[last];
+    memUsedKB[i] = memUsedKB[last];
+    ppids[i] = ppids[last];
+    threads[i] = threads[last];
+    startTimes[i] = startTimes[last];
+    swapKB[i] = swapKB[last];
+    pssKB[i] = pssKB[last];
+    ussKB[i] = ussKB[last];
+    pssRssKB[i] = pssRssKB[last];
+    ioReadBytes[i] = ioReadBytes[last];
+    ioWriteBytes[i] = ioWriteBytes[last];
+    ioReadAt[i] = ioReadAt[last];
+    readBytesPerSec[i] = readBytesPerSec[last];
+    writeBytesPerSec[i] = writeBytesPerSec[last];
+    cpuTicks[i] = cpuTicks[last];
+    readTotals[i] = readTotals[last];
+    nextReads[i] = nextReads[last];
+    idleReads[i] = idleReads[last];
+    seenTick[i] = seenTick[last];
+    index[pids[i]] = i;
+  }
+
+  pids.pop_back();
+  names.pop_back();
+  states.pop_back();
+  cpuUsed.pop_back();
+  memUsedKB.pop_back();
+  ppids.pop_back();
+  threads.pop_back();
+  startTimes.pop_back();
+  swapKB.pop_back();
+  pssKB.pop_back();
+  ussKB.pop_back();
+  pssRssKB.pop_back();
+  ioReadBytes.pop_back();
+  ioWriteBytes.pop_back();
+  ioReadAt.pop_back();
+  readBytesPerSec.pop_back();
+  writeBytesPerSec.pop_back();
+  cpuTicks.pop_back();
+  readTotals.pop_back();
+  nextReads.pop_back();
+  idleReads.pop_back();
+  seenTick.pop_back();
+}
+
+void ProcessStore::endTick() {
+  removed.clear();
+  // Walk backwards so that the row moved into a freed slot was already
+  // checked
+  for (size_t i = pids.size(); i-- > 0;) {
+    if (seenTick[i] != tick) {
+      removed.push_back(pids[i]);
+      removeRow(i);
+    }
+  }
+}
+
+void ProcessStore::selectTop(SortKey key, size_t n,
+                             std::vector<size_t>& rows) const {
+  auto better = [this, key](size_t a, size_t b) {
+    switch (key) {
+      case SortKey::Cpu:
+        if (cpuUsed[a] != cpuUsed[b]) return cpuUsed[a] > cpuUsed[b];
+        break;
+      case SortKey::Memory:
+        if (memUsedKB[a] != memUsedKB[b]) return memUsedKB[a] > memUsedKB[b];
+        break;
+      case SortKey::Io: {
+        double ioA = readBytesPerSec[a] + writeBytesPerSec[a];
+        double ioB = readBytesPerSec[b] + writeBytesPerSec[b];
+
+        if (ioA != ioB) return ioA > ioB;
+        break;
+      }
+      case SortKey::Pid:
+        break;
+    }
+    return pids[a] < pids[b];
+  };
+
+  rows.resize(size());
+  for (size_t i = 0; i < rows.size(); i++) rows[i] = i;
+
+  // Partition out the top n in linear time, then order only those
+  n = std::min(n, rows.size());
+  std::nth_element(rows.begin(), rows.begin() + n, rows.end(), better);
+  rows.resize(n);
+  std::sort(rows.begin(), rows.end(), better);
+}
+
+ProcessInfo ProcessStore::row(size_t i) const {
+  return ProcessInfo{.pid = pids[i],
+                     .name = names[i],
+                     .state = states[i],
+                     .cpuUsed = cpuUsed[i],
+                     .cpuEstimated = false,
+                     .memUsedKB = memUsedKB[i],
+                     .ppid = ppids[i],
+                     .threads = threads[i],
+                     .startTime = startTimes[i],
+                     .swapKB = swapKB[i],
+                     .pssKB = pssKB[i],
+                     .ussKB = ussKB[i],
+                     .readBytesPerSec = readBytesPerSec[i],
+                     .writeBytesPerSec = writeBytesPerSec[i],
+                     .depth = 0,
+                     .subtreeCpuUsed = 0.0,
+                     .subtreeMemKB = 0};
+}
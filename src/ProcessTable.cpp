@@ -1,39 +1,48 @@
 #include "ProcessTable.h"
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 #include <algorithm>
 #include <cctype>
-#include <chrono>
-#include <filesystem>
-#include <fstream>
+#include <charconv>
+#include <cstdlib>
+#include <iomanip>
 #include <iostream>
-#include <sstream>
 #include <string>
-#include <thread>
-#include <unordered_map>
 
+#include "SelfStats.h"
 #include "SystemInfo.h"
 
-std::ostream& operator<<(std::ostream& os, const ProcessState& state) {
+const char* processStateName(ProcessState state) {
   switch (state) {
     case ProcessState::Running:
-      return os << "Running";
+      return "Running";
     case ProcessState::Sleeping:
-      return os << "Sleeping";
+      return "Sleeping";
     case ProcessState::DiskSleep:
-      return os << "Disk Sleep";
+      return "Disk Sleep";
     case ProcessState::Stopped:
-      return os << "Stopped";
+      return "Stopped";
     case ProcessState::Zombie:
-      return os << "Zombie";
+      return "Zombie";
     case ProcessState::Dead:
-      return os << "Dead";
+      return "Dead";
     case ProcessState::Idle:
-      return os << "Idle";
+      return "Idle";
     default:
-      return os << "Unknown";
+      return "Unknown";
   }
 }
 
+std::ostream& operator<<(std::ostream& os, const ProcessState& state) {
+  return os << processStateName(state);
+}
+
 std::ostream& operator<<(std::ostream& os, const ProcessInfo& info) {
   os << std::left << std::setw(8) << info.pid << std::setw(40) << info.name
      << std::setw(10) << info.state << std::setw(6) << std::fixed
@@ -41,16 +50,12 @@ std::ostream& operator<<(std::ostream& os, const ProcessInfo& info) {
   return os;
 }
 
-void ProcessTable::printTableHeader() const {
-  std::cout << std::left << std::setw(8) << "PID" << std::setw(40) << "Name"
-            << std::setw(10) << "State" << std::setw(6) << "% CPU"
-            << std::setw(10) << "RAM KB" << "\n";
-}
-
-namespace fs = std::filesystem;
-
-static bool isNumber(const std::string& s) {
-  return !s.empty() && std::all_of(s.begin(), s.end(), ::isdigit);
+static bool isNumber(const char* s) {
+  if (*s == '\0') return false;
+  for (; *s; s++) {
+    if (!std::isdigit(static_cast<unsigned char>(*s))) return false;
+  }
+  return true;
 }
 
 static ProcessState stateToProcessState(char state) {
@@ -74,92 +79,659 @@ static ProcessState stateToProcessState(char state) {
   }
 }
 
-ProcessInfo getProcessInfo(const std::string& pid) {
-  std::string commPath = "/proc/" + pid + "/comm";
-  std::string statusPath = "/proc/" + pid + "/status";
+static const long pageSizeKB = sysconf(_SC_PAGESIZE) / 1024;
+
+// Read the storage I/O counters of /proc/<pid>/io. Returns false if the file
+// cannot be read, e.g. for another user's process without privileges.
+static bool readProcessIo(const char* root, int pid, std::vector<char>& buffer,
+                          unsigned long& readBytes,
+                          unsigned long& writeBytes) {
+  char path[PATH_MAX];
+
+  snprintf(path, sizeof(path), "%s/%d/io", root, pid);
 
-  std::ifstream commFile(commPath);
-  std::ifstream statusFile(statusPath);
-  ProcessInfo result;
+  std::string_view io = readProcFile(path, buffer);
 
-  std::string name;
-  if (commFile) {
-    std::getline(commFile, name);
+  if (io.empty()) return false;
+  readBytes = writeBytes = 0;
+  while (!io.empty()) {
+    std::string_view line = nextLine(io);
+    std::string_view label = nextToken(line);
+
+    if (label == "read_bytes:") {
+      nextUnsigned(line, readBytes);
+    } else if (label == "write_bytes:") {
+      nextUnsigned(line, writeBytes);
+    }
   }
 
-  std::string line;
-  std::string state;
-  unsigned long memory = 0;
+  return true;
+}
+
+// Fill info from /proc/<pid>/stat plus the optional fields. Returns false if
+// the process exited before it could be read.
+static bool getProcessInfo(const std::string& procRoot, int pid,
+                           unsigned fields, std::vector<char>& buffer,
+                           ProcessInfo& info, unsigned long& cpuTime) {
+  char path[PATH_MAX];
+  const char* root = procRoot.c_str();
+  ProcStat stat;
+
+  snprintf(path, sizeof(path), "%s/%d/stat", root, pid);
+  if (!parseProcStat(readProcFile(path, buffer), stat)) return false;
 
-  while (std::getline(statusFile, line)) {
-    std::istringstream iss(line);
-    std::string label;
+  info.pid = pid;
+  info.name.assign(stat.comm);
+  info.state = stateToProcessState(stat.state);
+  info.memUsedKB = stat.rssPages * pageSizeKB;
+  info.ppid = stat.ppid;
+  info.threads = stat.numThreads;
+  info.startTime = stat.startTime;
+  info.swapKB = 0;
+  cpuTime = stat.utime + stat.stime;
 
-    if (line.rfind("State:", 0) == 0) iss >> label >> state;
-    if (line.rfind("VmRSS:", 0) == 0) iss >> label >> memory;
+  if (fields & ProcessTable::FieldFullName) {
+    snprintf(path, sizeof(path), "%s/%d/comm", root, pid);
+    std::string_view comm = readProcFile(path, buffer);
+    if (!comm.empty()) info.name.assign(nextLine(comm));
   }
 
-  result.name = name;
-  result.pid = pid;
-  result.state = stateToProcessState(state.data()[0]);
-  result.memUsedKB = memory;
+  if (fields & ProcessTable::FieldSwap) {
+    snprintf(path, sizeof(path), "%s/%d/status", root, pid);
+    std::string_view status = readProcFile(path, buffer);
+
+    while (!status.empty()) {
+      std::string_view line = nextLine(status);
 
-  return result;
+      if (nextToken(line) == "VmSwap:") {
+        nextUnsigned(line, info.swapKB);
+        break;
+      }
+    }
+  }
+
+  return true;
 }
 
-static unsigned long procCpuTime(const std::string& pid) {
-  std::ifstream file("/proc/" + pid + "/stat");
-  unsigned long utime, stime;
-  std::string token;
+ProcessTable::ProcessTable(unsigned fields, unsigned scanThreads,
+                           const std::string& procRoot)
+    : fields(fields),
+      procRoot(procRoot),
+      statFile(procRoot + "/stat"),
+      uptimeFile(procRoot + "/uptime"),
+      direntBuffer(procReadBufferSize) {
+  if (scanThreads > 1) {
+    this->scanPool = std::make_unique<WorkerPool>(scanThreads);
+  }
+  this->scanResults.resize(scanThreads > 1 ? scanThreads : 1);
+}
 
-  // skip first 13 fields
-  for (int i = 0; i < 13; ++i) file >> token;
-  file >> utime >> stime;
+// Layout of the records returned by getdents64(2)
+struct LinuxDirent64 {
+  ino64_t d_ino;
+  off64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
 
-  return utime + stime;
+// Append the numeric subdirectories of path (PIDs or TIDs) to ids
+static void listNumericDirs(const char* path, std::vector<char>& buffer,
+                            std::vector<int>& ids) {
+  int fd = ::open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+  if (fd < 0) return;
+  SelfStats::instance().countOpen();
+
+  while (true) {
+    long n = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+
+    if (n <= 0) break;
+    SelfStats::instance().countRead(n);
+
+    for (long offset = 0; offset < n;) {
+      auto* entry = reinterpret_cast<LinuxDirent64*>(buffer.data() + offset);
+
+      offset += entry->d_reclen;
+      if (entry->d_type != DT_DIR || !isNumber(entry->d_name)) continue;
+      ids.push_back(std::atoi(entry->d_name));
+    }
+  }
+
+  ::close(fd);
 }
 
-std::vector<ProcessInfo> ProcessTable::getProcesses() const {
-  std::vector<ProcessInfo> res;
-  SystemInfo sysInfo = SystemInfo(this->snapshotsSleepMs);
-  std::string cpuStr;
-  std::ifstream statFile("/proc/stat");
-  getline(statFile, cpuStr);
-  CpuTimes totalSnapshot1 = sysInfo.getCpuTimes(cpuStr);
-  std::unordered_map<std::string, unsigned long> procTimes1;
-  int numCpus = std::thread::hardware_concurrency();
+bool ProcessTable::enableProcEvents(std::string& error) {
+  auto connector = std::make_unique<ProcConnector>();
+
+  if (!connector->open(error)) return false;
+  this->connector = std::move(connector);
+  this->connectorSynced = false;
+  return true;
+}
 
-  for (const auto& entry : fs::directory_iterator("/proc")) {
-    std::string filename = entry.path().filename().string();
-    ProcessInfo info;
+void ProcessTable::limitToPids(const std::vector<int>& pids) {
+  this->pidsLimited = true;
+  this->limitPids = pids;
+}
+
+void ProcessTable::listPids() {
+  PhaseTimer timer(Phase::DirScan);
+
+  // The connector is still drained, for the system-wide event counts and so
+  // that its socket does not overflow
+  if (this->pidsLimited) {
+    if (this->connector) this->connector->drain(this->events);
+    this->pids = this->limitPids;
+    return;
+  }
+
+  // The connector replays the events queued since the last listing on top of
+  // it, so /proc only has to be listed again if events were lost
+  if (this->connector && this->connector->drain(this->events) &&
+      this->connectorSynced) {
+    const auto& live = this->connector->pids();
+
+    this->pids.assign(live.begin(), live.end());
+    return;
+  }
+
+  this->pids.clear();
+  listNumericDirs(this->procRoot.c_str(), this->direntBuffer, this->pids);
+  if (this->connector) {
+    this->connector->reset(this->pids);
+    this->connectorSynced = true;
+  }
+}
 
-    if (entry.is_directory() && isNumber(filename)) {
-      info = getProcessInfo(filename);
-      res.push_back(info);
-      procTimes1[filename] = procCpuTime(filename);
+void ProcessTable::enableAdaptiveSampling(size_t readBudget) {
+  this->adaptive = true;
+  this->readBudget = readBudget;
+}
+
+void ProcessTable::selectReads() {
+  // Files read per process
+  size_t cost = 1 + ((this->scanFields & FieldFullName) ? 1 : 0) +
+                ((this->scanFields & FieldSwap) ? 1 : 0) +
+                ((this->scanFields & FieldIo) ? 1 : 0);
+  size_t maxReads = this->readBudget > 0
+                        ? std::max<size_t>(this->readBudget / cost, 1)
+                        : SIZE_MAX;
+
+  this->dueReads.clear();
+  for (int pid : this->pids) {
+    size_t row = this->store.find(pid);
+
+    if (row == ProcessStore::npos) {
+      this->dueReads.emplace_back(0, 0, pid);
+    } else if (this->store.nextReads[row] <= this->updates) {
+      this->dueReads.emplace_back(this->store.nextReads[row],
+                                  this->store.readTotals[row], pid);
+    } else {
+      this->store.touch(row);
     }
   }
 
-  std::this_thread::sleep_for(
-      std::chrono::milliseconds(this->snapshotsSleepMs));
+  // New and displayed processes are due since 0, so they go first, then
+  // everything else by how long it has been due. Ties go to the row read
+  // longest ago, so that a budget too small for all of them takes turns
+  // rather than always reading the lowest PIDs. The rest waits for the next
+  // tick; rows already in the store are kept until then.
+  if (this->dueReads.size() > maxReads) {
+    std::nth_element(this->dueReads.begin(),
+                     this->dueReads.begin() + maxReads, this->dueReads.end());
+    for (size_t i = maxReads; i < this->dueReads.size(); i++) {
+      size_t row = this->store.find(std::get<int>(this->dueReads[i]));
 
-  statFile.clear();
-  statFile.seekg(0);
-  getline(statFile, cpuStr);
-  CpuTimes totalSnapshot2 = sysInfo.getCpuTimes(cpuStr);
+      if (row != ProcessStore::npos) this->store.touch(row);
+    }
+    this->dueReads.resize(maxReads);
+  }
 
-  for (auto& x : res) {
-    unsigned long procTime2 = procCpuTime(x.pid);
+  this->readPids.clear();
+  for (const auto& due : this->dueReads) {
+    this->readPids.push_back(std::get<int>(due));
+  }
+}
 
-    double deltaProc = procTime2 - procTimes1[x.pid];
-    double deltaTotal = totalSnapshot2.total - totalSnapshot1.total;
+void ProcessTable::scanPids(const std::vector<int>& list, size_t begin,
+                            size_t end, ScanResult& result) const {
+  for (size_t i = begin; i < end; i++) {
+    ProcessInfo& info = result.procs.emplace_back();
+    unsigned long procTime;
 
-    x.cpuUsed = (deltaProc / deltaTotal) * numCpus * 100.0;
+    if (!getProcessInfo(this->procRoot, list[i], this->scanFields,
+                        result.readBuffer, info, procTime)) {
+      result.procs.pop_back();
+      continue;
+    }
+    result.cpuTimes.push_back(procTime);
+    if (this->scanFields & FieldIo) {
+      IoCounters& io = result.io.emplace_back();
+
+      readProcessIo(this->procRoot.c_str(), list[i], result.readBuffer,
+                    io.readBytes, io.writeBytes);
+    }
   }
+}
 
-  std::sort(res.begin(), res.end(), [](ProcessInfo& a, ProcessInfo& b) {
-    return a.cpuUsed > b.cpuUsed;
-  });
+double ProcessTable::uptimeTicks() {
+  std::string_view uptime = uptimeFile.read();
+  double seconds = 0;
+
+  std::from_chars(uptime.data(), uptime.data() + uptime.size(), seconds);
+  return seconds * sysconf(_SC_CLK_TCK);
+}
+
+void ProcessTable::update() {
+  std::string_view stat = statFile.read();
+  CpuTimes totalSnapshot = SystemInfo::getCpuTimes(nextLine(stat));
+  double deltaTotal = totalSnapshot.total - this->prevTotalTime;
+  // PIDs per shard, small enough to balance, large enough to amortize the
+  // shard hand-off
+  constexpr size_t scanShardSize = 64;
+
+  // Per-process usage is relative to a single core, the aggregate line sums
+  // all of the "cpuN" lines that follow it
+  this->numCpus = 0;
+  while (stat.starts_with("cpu")) {
+    nextLine(stat);
+    this->numCpus++;
+  }
+
+  auto now = std::chrono::steady_clock::now();
+
+  // I/O rates are only needed for every process to sort on them
+  this->scanFields = this->fields;
+  if (this->lastSortKey != SortKey::Io) this->scanFields &= ~FieldIo;
+
+  this->events = ProcessEvents();
+  listPids();
+  this->updates++;
+  this->store.beginTick();
+  if (this->adaptive) selectReads();
+
+  const std::vector<int>& toRead = this->adaptive ? this->readPids : this->pids;
+  size_t readCount = 0;
+
+  for (auto& result : this->scanResults) {
+    result.procs.clear();
+    result.cpuTimes.clear();
+    result.io.clear();
+  }
+
+  if (this->scanPool) {
+    PhaseTimer timer(Phase::Parse);
+
+    this->scanPool->run(
+        toRead.size(), scanShardSize,
+        [this, &toRead](unsigned worker, size_t begin, size_t end) {
+          scanPids(toRead, begin, end, this->scanResults[worker]);
+        });
+  } else {
+    PhaseTimer timer(Phase::Parse);
+
+    scanPids(toRead, 0, toRead.size(), this->scanResults[0]);
+  }
+
+  // Merge the per-worker results. Workers never touch the store, so this is
+  // the only place it is updated.
+  PhaseTimer deltaTimer(Phase::CpuDelta);
+
+  // Read once, and only if needed
+  double uptime = -1;
+
+  for (auto& result : this->scanResults) {
+    for (size_t i = 0; i < result.procs.size(); i++) {
+      ProcessInfo& info = result.procs[i];
+      size_t row = this->store.upsert(info.pid);
+
+      // A new start time means the PID was reused: the counters of the old
+      // process are no base for deltas, and its place in the tree goes too
+      if (this->store.readTotals[row] != 0 &&
+          info.startTime != this->store.startTimes[row]) {
+        this->store.reset(row);
+        if (this->tree) this->tree->remove(info.pid);
+      }
+
+      // Processes read for the first time have zero in cpuTicks, i.e. are
+      // measured over their whole lifetime, or at least the last interval:
+      // a process that the read budget kept waiting is older than that.
+      // Aggregate CPU time runs numCpus times faster than the clock. Rows
+      // skipped by adaptive sampling are measured since their last read.
+      double deltaProc = static_cast<double>(result.cpuTimes[i]) -
+                         static_cast<double>(this->store.cpuTicks[row]);
+      double deltaRow = deltaTotal;
+
+      if (this->store.readTotals[row] > 0) {
+        deltaRow = totalSnapshot.total - this->store.readTotals[row];
+      } else if (this->prevTotalTime > 0) {
+        if (uptime < 0) uptime = uptimeTicks();
+        deltaRow = std::max(
+            (uptime - static_cast<double>(info.startTime)) * this->numCpus,
+            deltaTotal);
+      }
+
+      if (this->adaptive) {
+        bool active = deltaProc > 0 ||
+                      info.memUsedKB != this->store.memUsedKB[row] ||
+                      info.state == ProcessState::Running ||
+                      info.state == ProcessState::DiskSleep;
+        unsigned& idle = this->store.idleReads[row];
+
+        idle = active ? 0 : idle + 1;
+        this->store.nextReads[row] =
+            this->updates + std::min(1ul << std::min(idle, 31u),
+                                     maxIdleInterval);
+      }
+
+      double cpuUsed =
+          deltaRow > 0 ? (deltaProc / deltaRow) * this->numCpus * 100.0
+                       : 0.0;
+      // Only new and changed processes walk up the tree
+      bool treeChanged = this->tree && (this->store.readTotals[row] == 0 ||
+                                        cpuUsed != this->store.cpuUsed[row] ||
+                                        info.memUsedKB !=
+                                            this->store.memUsedKB[row] ||
+                                        info.ppid != this->store.ppids[row]);
+
+      this->store.cpuUsed[row] = cpuUsed;
+      this->store.cpuTicks[row] = result.cpuTimes[i];
+      this->store.readTotals[row] = totalSnapshot.total;
+      this->store.names[row].swap(info.name);
+      this->store.states[row] = info.state;
+      this->store.memUsedKB[row] = info.memUsedKB;
+      this->store.ppids[row] = info.ppid;
+      this->store.threads[row] = info.threads;
+      this->store.startTimes[row] = info.startTime;
+      this->store.swapKB[row] = info.swapKB;
+      if (this->scanFields & FieldIo) setIo(row, result.io[i], now);
+      if (treeChanged) {
+        this->tree->set(info.pid, info.ppid, this->store.cpuUsed[row],
+                        info.memUsedKB);
+      }
+    }
+    readCount += result.procs.size();
+  }
+
+  // Drop processes that have exited
+  this->store.endTick();
+  if (this->tree) {
+    for (int pid : this->store.removedPids()) this->tree->remove(pid);
+  }
+  this->prevTotalTime = totalSnapshot.total;
+
+  // A PID the connector still lists but that could not be read has exited
+  // with its event lost
+  if (this->connector && readCount != toRead.size()) {
+    for (int pid : toRead) {
+      if (this->store.find(pid) == ProcessStore::npos) {
+        this->connector->remove(pid);
+      }
+    }
+  }
+}
+
+void ProcessTable::setIo(size_t row, const IoCounters& io,
+                         std::chrono::steady_clock::time_point now) {
+  auto& readAt = this->store.ioReadAt[row];
+  double seconds = std::chrono::duration<double>(now - readAt).count();
+
+  // No rate before there is a baseline; counters that went backwards belong
+  // to a reused PID
+  if (readAt != std::chrono::steady_clock::time_point() && seconds > 0 &&
+      io.readBytes >= this->store.ioReadBytes[row] &&
+      io.writeBytes >= this->store.ioWriteBytes[row]) {
+    this->store.readBytesPerSec[row] =
+        (io.readBytes - this->store.ioReadBytes[row]) / seconds;
+    this->store.writeBytesPerSec[row] =
+        (io.writeBytes - this->store.ioWriteBytes[row]) / seconds;
+  } else {
+    this->store.readBytesPerSec[row] = 0.0;
+    this->store.writeBytesPerSec[row] = 0.0;
+  }
+  this->store.ioReadBytes[row] = io.readBytes;
+  this->store.ioWriteBytes[row] = io.writeBytes;
+  readAt = now;
+}
+
+void ProcessTable::readPss(size_t row) {
+  char path[PATH_MAX];
+  unsigned long pss = 0, privateClean = 0, privateDirty = 0;
+
+  snprintf(path, sizeof(path), "%s/%d/smaps_rollup", this->procRoot.c_str(),
+           this->store.pids[row]);
+
+  // Empty for kernel threads, unreadable for other users' processes without
+  // privileges; both are recorded as read so they are not retried
+  std::string_view rollup = readProcFile(path, this->pssBuffer);
+
+  while (!rollup.empty()) {
+    std::string_view line = nextLine(rollup);
+    std::string_view label = nextToken(line);
+
+    if (label == "Pss:") {
+      nextUnsigned(line, pss);
+    } else if (label == "Private_Clean:") {
+      nextUnsigned(line, privateClean);
+    } else if (label == "Private_Dirty:") {
+      nextUnsigned(line, privateDirty);
+    }
+  }
+
+  this->store.pssKB[row] = pss;
+  this->store.ussKB[row] = privateClean + privateDirty;
+  this->store.pssRssKB[row] = this->store.memUsedKB[row];
+}
+
+void ProcessTable::refreshPss() {
+  PhaseTimer timer(Phase::Pss);
+  auto deadline = std::chrono::steady_clock::now() + this->pssBudget;
+  size_t rows = this->store.size();
+
+  // The displayed processes first, whether they changed or not
+  for (size_t row : this->topRows) {
+    if (std::chrono::steady_clock::now() >= deadline) break;
+    readPss(row);
+  }
+
+  // Then whatever changed, picking up where the previous tick left off. One
+  // is read even if the displayed processes used up the budget, so that the
+  // cursor always moves on.
+  bool progressed = false;
+
+  for (size_t i = 0; i < rows; i++) {
+    size_t row = (this->pssCursor + i) % rows;
+
+    if (this->store.pssRssKB[row] == this->store.memUsedKB[row]) continue;
+    if (progressed && std::chrono::steady_clock::now() >= deadline) {
+      this->pssCursor = row;
+      return;
+    }
+    readPss(row);
+    progressed = true;
+    this->pssCursor = row + 1;
+  }
+}
+
+void ProcessTable::enableTree(bool enable) {
+  if (!enable) {
+    this->tree.reset();
+    return;
+  }
+  if (this->tree) return;
+
+  this->tree = std::make_unique<ProcessTree>();
+  for (size_t row = 0; row < this->store.size(); row++) {
+    this->tree->set(this->store.pids[row], this->store.ppids[row],
+                    this->store.cpuUsed[row], this->store.memUsedKB[row]);
+  }
+}
+
+std::vector<ProcessInfo> ProcessTable::getTopProcesses(size_t n, SortKey key) {
+  {
+    PhaseTimer timer(Phase::Sort);
+
+    this->store.selectTop(key, n, this->topRows);
+  }
+
+  return readTopRows(key);
+}
+
+std::vector<ProcessInfo> ProcessTable::getProcessTree(size_t n, SortKey key) {
+  enableTree(true);
+  {
+    PhaseTimer timer(Phase::Sort);
+
+    this->tree->select(key, n, this->treeRows);
+    this->topRows.clear();
+    for (const auto& [pid, depth] : this->treeRows) {
+      this->topRows.push_back(this->store.find(pid));
+    }
+  }
+
+  std::vector<ProcessInfo> res = readTopRows(key);
+
+  for (size_t i = 0; i < res.size(); i++) {
+    res[i].depth = this->treeRows[i].second;
+    res[i].subtreeCpuUsed = this->tree->subtreeCpu(res[i].pid);
+    res[i].subtreeMemKB = this->tree->subtreeMemKB(res[i].pid);
+  }
 
   return res;
 }
+
+std::vector<ProcessInfo> ProcessTable::readTopRows(SortKey key) {
+  std::vector<ProcessInfo> res;
+
+  // Displayed processes are re-read on every tick with adaptive sampling
+  for (size_t row : this->topRows) this->store.nextReads[row] = 0;
+
+  // Unless update() already read them for every process, I/O rates are read
+  // for the displayed processes only
+  if ((this->fields & FieldIo) && !(this->scanFields & FieldIo)) {
+    PhaseTimer timer(Phase::Parse);
+    auto now = std::chrono::steady_clock::now();
+
+    for (size_t row : this->topRows) {
+      IoCounters io;
+
+      if (readProcessIo(this->procRoot.c_str(), this->store.pids[row],
+                        this->ioBuffer, io.readBytes, io.writeBytes)) {
+        setIo(row, io, now);
+      }
+    }
+  }
+  this->lastSortKey = key;
+  if (this->pssBudget.count() > 0) refreshPss();
+  res.reserve(this->topRows.size());
+  for (size_t row : this->topRows) {
+    res.push_back(this->store.row(row));
+    // Rows read by the last update() have its total as their base
+    res.back().cpuEstimated =
+        this->store.readTotals[row] != this->prevTotalTime;
+  }
+
+  return res;
+}
+
+void ProcessTable::readTasks(int pid, TaskCache& cache) {
+  char path[PATH_MAX];
+  const char* root = this->procRoot.c_str();
+  double deltaTotal =
+      cache.totalTime > 0 ? this->prevTotalTime - cache.totalTime : 0;
+  // Index of the next cached thread to match against
+  size_t old = 0;
+
+  snprintf(path, sizeof(path), "%s/%d/task", root, pid);
+  this->tids.clear();
+  listNumericDirs(path, this->direntBuffer, this->tids);
+  std::sort(this->tids.begin(), this->tids.end());
+
+  this->newThreads.clear();
+  this->newTicks.clear();
+
+  for (int tid : this->tids) {
+    ProcStat stat;
+
+    snprintf(path, sizeof(path), "%s/%d/task/%d/stat", root, pid, tid);
+    if (!parseProcStat(readProcFile(path, this->taskBuffer), stat)) continue;
+
+    unsigned long ticks = stat.utime + stat.stime;
+    ThreadInfo& info = this->newThreads.emplace_back();
+
+    // Both lists are ordered by TID, so the previous ticks of a thread are
+    // found by walking the cached list alongside
+    while (old < cache.threads.size() && cache.threads[old].tid < tid) old++;
+    if (old < cache.threads.size() && cache.threads[old].tid == tid &&
+        deltaTotal > 0) {
+      double deltaThread = ticks - cache.cpuTicks[old];
+
+      info.cpuUsed = (deltaThread / deltaTotal) * this->numCpus * 100.0;
+    } else {
+      // No baseline yet: the thread is new or this is the first read
+      info.cpuUsed = 0.0;
+    }
+
+    info.tid = tid;
+    info.pid = pid;
+    info.name.assign(stat.comm);
+    info.state = stateToProcessState(stat.state);
+    this->newTicks.push_back(ticks);
+  }
+
+  cache.threads.swap(this->newThreads);
+  cache.cpuTicks.swap(this->newTicks);
+}
+
+void ProcessTable::getThreads(const std::vector<ProcessInfo>& procs,
+                              size_t n, std::vector<ThreadInfo>& threads) {
+  PhaseTimer timer(Phase::Tasks);
+
+  threads.clear();
+  n = std::min(n, procs.size());
+
+  for (size_t i = 0; i < n; i++) {
+    int pid = procs[i].pid;
+    size_t row = this->store.find(pid);
+
+    if (row == ProcessStore::npos) continue;
+
+    auto [it, inserted] = this->taskCaches.try_emplace(pid);
+    TaskCache& cache = it->second;
+
+    if (cache.startTime != this->store.startTimes[row]) {
+      cache = TaskCache();
+      cache.startTime = this->store.startTimes[row];
+    }
+
+    unsigned long procTicks = this->store.cpuTicks[row];
+    unsigned long numThreads = this->store.threads[row];
+
+    // Threads cannot have used CPU if their process did not, so a process
+    // that stayed idle with the same thread count keeps its cached threads
+    if (cache.totalTime == 0 || procTicks != cache.procTicks ||
+        numThreads != cache.numThreads) {
+      readTasks(pid, cache);
+    } else {
+      for (ThreadInfo& info : cache.threads) info.cpuUsed = 0.0;
+    }
+    cache.procTicks = procTicks;
+    cache.numThreads = numThreads;
+    cache.totalTime = this->prevTotalTime;
+
+    size_t first = threads.size();
+
+    threads.insert(threads.end(), cache.threads.begin(), cache.threads.end());
+    std::sort(threads.begin() + first, threads.end(),
+              [](const ThreadInfo& a, const ThreadInfo& b) {
+                if (a.cpuUsed != b.cpuUsed) return a.cpuUsed > b.cpuUsed;
+                return a.tid < b.tid;
+              });
+  }
+
+  // Forget processes that have exited
+  std::erase_if(this->taskCaches, [this](const auto& entry) {
+    return this->store.find(entry.first) == ProcessStore::npos;
+  });
+}
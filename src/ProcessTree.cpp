@@ -0,0 +1,198 @@
+#include "ProcessTree.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Percent to the hundredths the sums are kept in
+static unsigned long toCenti(double percent) {
+  return percent > 0 ? static_cast<unsigned long>(std::lround(percent * 100))
+                     : 0;
+}
+
+ProcessTree::ProcessTree() { clear(); }
+
+void ProcessTree::clear() {
+  nodes.clear();
+  nodes.try_emplace(0);
+  presentCount = 0;
+}
+
+// Sums are unsigned, so subtracting is adding the wrapped-around negation
+void ProcessTree::addToPath(int pid, unsigned long cpu, unsigned long memKB) {
+  for (int p = pid;;) {
+    Node& node = nodes.find(p)->second;
+
+    node.treeCpu += cpu;
+    node.treeMemKB += memKB;
+    if (p == 0) break;
+    p = node.parent;
+  }
+}
+
+void ProcessTree::link(int pid, Node& node, int parent) {
+  // A parent below pid would close a loop, which a PID reused between two
+  // reads can fake; hang the process at the top instead
+  for (int p = parent; p != 0;) {
+    auto it = nodes.find(p);
+
+    if (p == pid) {
+      parent = 0;
+      break;
+    }
+    if (it == nodes.end()) break;
+    p = it->second.parent;
+  }
+
+  auto [it, inserted] = nodes.try_emplace(parent);
+
+  // Not seen yet: a placeholder at the top until it is set()
+  if (inserted) link(parent, it->second, 0);
+
+  node.parent = parent;
+  node.indexInParent = it->second.children.size();
+  it->second.children.push_back(pid);
+}
+
+void ProcessTree::unlink(Node& node) {
+  std::vector<int>& siblings = nodes.find(node.parent)->second.children;
+  int moved = siblings.back();
+
+  siblings[node.indexInParent] = moved;
+  nodes.find(moved)->second.indexInParent = node.indexInParent;
+  siblings.pop_back();
+}
+
+void ProcessTree::dropIfUnused(int pid) {
+  auto it = nodes.find(pid);
+
+  // A placeholder without children has nothing in its sums either
+  if (pid == 0 || it == nodes.end() || it->second.present ||
+      !it->second.children.empty()) {
+    return;
+  }
+  unlink(it->second);
+  nodes.erase(it);
+}
+
+void ProcessTree::set(int pid, int ppid, double cpuUsed,
+                      unsigned long memKB) {
+  if (pid == 0) return;
+  if (ppid == pid) ppid = 0;
+
+  auto [it, inserted] = nodes.try_emplace(pid);
+  Node& node = it->second;
+
+  if (!node.present) {
+    node.present = true;
+    presentCount++;
+  }
+
+  if (inserted) {
+    link(pid, node, ppid);
+  } else if (node.parent != ppid) {
+    // Reparented, or a placeholder that now knows its parent: the whole
+    // subtree moves from one path to the other
+    int oldParent = node.parent;
+
+    addToPath(oldParent, 0 - node.treeCpu, 0 - node.treeMemKB);
+    unlink(node);
+    link(pid, node, ppid);
+    addToPath(node.parent, node.treeCpu, node.treeMemKB);
+    dropIfUnused(oldParent);
+  }
+
+  unsigned long cpu = toCenti(cpuUsed);
+
+  if (cpu != node.cpu || memKB != node.memKB) {
+    addToPath(pid, cpu - node.cpu, memKB - node.memKB);
+    node.cpu = cpu;
+    node.memKB = memKB;
+  }
+}
+
+void ProcessTree::remove(int pid) {
+  auto it = nodes.find(pid);
+
+  if (pid == 0 || it == nodes.end() || !it->second.present) return;
+
+  Node& node = it->second;
+  int parent = node.parent;
+
+  addToPath(parent, 0 - node.treeCpu, 0 - node.treeMemKB);
+  for (int child : node.children) {
+    Node& childNode = nodes.find(child)->second;
+
+    link(child, childNode, 0);
+    addToPath(0, childNode.treeCpu, childNode.treeMemKB);
+  }
+  node.children.clear();
+  unlink(node);
+  nodes.erase(it);
+  presentCount--;
+  dropIfUnused(parent);
+}
+
+double ProcessTree::subtreeCpu(int pid) const {
+  auto it = nodes.find(pid);
+
+  return it == nodes.end() ? 0.0 : it->second.treeCpu / 100.0;
+}
+
+unsigned long ProcessTree::subtreeMemKB(int pid) const {
+  auto it = nodes.find(pid);
+
+  return it == nodes.end() ? 0 : it->second.treeMemKB;
+}
+
+void ProcessTree::walk(int pid, unsigned depth, SortKey key, size_t n,
+                       std::vector<std::pair<int, unsigned>>& rows) {
+  auto better = [this, key](int a, int b) {
+    const Node& x = nodes.find(a)->second;
+    const Node& y = nodes.find(b)->second;
+
+    switch (key) {
+      case SortKey::Cpu:
+      case SortKey::Io:
+        if (x.treeCpu != y.treeCpu) return x.treeCpu > y.treeCpu;
+        break;
+      case SortKey::Memory:
+        if (x.treeMemKB != y.treeMemKB) return x.treeMemKB > y.treeMemKB;
+        break;
+      case SortKey::Pid:
+        break;
+    }
+    return a < b;
+  };
+  const std::vector<int>& children = nodes.find(pid)->second.children;
+  // Children of this level go to order[begin, end); deeper levels append
+  // after them and truncate back when done
+  size_t begin = order.size();
+
+  order.insert(order.end(), children.begin(), children.end());
+
+  size_t end = order.size();
+  // No more than the rows still wanted need to be ordered
+  size_t wanted = begin + std::min(end - begin, n - rows.size());
+
+  std::partial_sort(order.begin() + begin, order.begin() + wanted,
+                    order.begin() + end, better);
+  for (size_t i = begin; i < wanted && rows.size() < n; i++) {
+    int child = order[i];
+
+    if (nodes.find(child)->second.present) {
+      rows.emplace_back(child, depth);
+      walk(child, depth + 1, key, n, rows);
+    } else {
+      // The children of a placeholder take its place
+      walk(child, depth, key, n, rows);
+    }
+  }
+  order.resize(begin);
+}
+
+void ProcessTree::select(SortKey key, size_t n,
+                         std::vector<std::pair<int, unsigned>>& rows) {
+  rows.clear();
+  order.clear();
+  if (n > 0) walk(0, 0, key, n, rows);
+}
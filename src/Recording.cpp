@@ -0,0 +1,450 @@
+#include "Recording.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+// Bytes in front of every slot payload: u32 payload length, u64 seq
+constexpr size_t slotHeaderSize = 12;
+// Longest name stored in the string table
+constexpr size_t maxNameLength = 255;
+
+static void putVarint(std::string& out, uint64_t value) {
+  while (value >= 0x80) {
+    out += static_cast<char>(value | 0x80);
+    value >>= 7;
+  }
+  out += static_cast<char>(value);
+}
+
+// Signed deltas are zigzag-encoded so that small negatives stay short
+static void putDelta(std::string& out, int64_t delta) {
+  putVarint(out, (static_cast<uint64_t>(delta) << 1) ^ (delta >> 63));
+}
+
+static bool getVarint(std::string_view& in, uint64_t& value) {
+  value = 0;
+  for (int shift = 0; shift < 64 && !in.empty(); shift += 7) {
+    uint8_t byte = static_cast<uint8_t>(in.front());
+
+    in.remove_prefix(1);
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+static bool getDelta(std::string_view& in, int64_t& delta) {
+  uint64_t value;
+
+  if (!getVarint(in, value)) return false;
+  delta = static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+  return true;
+}
+
+// Percentages are stored in hundredths
+static unsigned long toCenti(double percent) {
+  return percent > 0 ? static_cast<unsigned long>(std::lround(percent * 100))
+                     : 0;
+}
+
+static double fromCenti(uint64_t centi) { return centi / 100.0; }
+
+static unsigned long toMillis(std::chrono::system_clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             time.time_since_epoch())
+      .count();
+}
+
+static bool isKeyframe(uint64_t seq) {
+  return seq % recordingKeyframeInterval == 0;
+}
+
+RecordingWriter::~RecordingWriter() {
+  if (fd >= 0) ::close(fd);
+}
+
+bool RecordingWriter::open(const std::string& path, uint64_t slotCount,
+                           std::string& error) {
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    error = path + ": " + strerror(errno);
+    return false;
+  }
+
+  std::memcpy(header.magic, recordingMagic, sizeof(header.magic));
+  header.version = recordingVersion;
+  header.slotSize = recordingSlotSize;
+  header.slotCount = std::max<uint64_t>(slotCount, recordingKeyframeInterval);
+  header.stringTableSize = recordingStringTableSize;
+
+  // The file is sparse: only slots that have been written take space
+  off_t fileSize = recordingHeaderSize + recordingStringTableSize +
+                   header.slotCount * recordingSlotSize;
+
+  if (ftruncate(fd, fileSize) != 0 ||
+      pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+    error = path + ": " + strerror(errno);
+    return false;
+  }
+
+  slot.reserve(recordingSlotSize);
+  return true;
+}
+
+uint32_t RecordingWriter::nameRef(const std::string& name) {
+  auto it = stringOffsets.find(name);
+
+  if (it != stringOffsets.end()) return it->second + 2;
+
+  size_t length = std::min(name.size(), maxNameLength);
+
+  if (header.stringTableUsed + 1 + length > header.stringTableSize) return 1;
+
+  uint32_t offset = header.stringTableUsed;
+  char entry[1 + maxNameLength];
+
+  entry[0] = static_cast<char>(length);
+  std::memcpy(entry + 1, name.data(), length);
+  if (pwrite(fd, entry, 1 + length, recordingHeaderSize + offset) !=
+      static_cast<ssize_t>(1 + length)) {
+    return 1;
+  }
+  header.stringTableUsed += 1 + length;
+  stringOffsets.emplace(name, offset);
+
+  return offset + 2;
+}
+
+void RecordingWriter::write(const Snapshot& snapshot,
+                            const ProcessStore& store, SortKey key) {
+  if (fd < 0) return;
+
+  uint64_t seq = header.nextSeq;
+  bool keyframe = isKeyframe(seq);
+  size_t capacity = recordingSlotSize - slotHeaderSize;
+
+  slot.clear();
+  written.clear();
+  putVarint(slot, toMillis(snapshot.timestamp));
+  putVarint(slot, snapshot.tick);
+  putVarint(slot, snapshot.missedDeadlines);
+  putVarint(slot, snapshot.processCount);
+  putVarint(slot, toCenti(snapshot.cpu.totalUsage));
+  putVarint(slot, snapshot.cpu.perCoreUsage.size());
+  for (double usage : snapshot.cpu.perCoreUsage) {
+    putVarint(slot, toCenti(usage));
+  }
+  putVarint(slot, snapshot.mem.totalKB);
+  putVarint(slot, snapshot.mem.usedKB);
+  putVarint(slot, snapshot.mem.availableKB);
+  putVarint(slot, toCenti(snapshot.mem.usedPercent));
+
+  // Processes go best first, so if the slot fills up it is the least
+  // interesting ones that are left out. They are encoded straight from the
+  // store's columns, without copying rows out.
+  int prevPid = 0;
+  store.selectTop(key, store.size(), order);
+  procBuffer.clear();
+  for (size_t row : order) {
+    int pid = store.pids[row];
+    const std::string& name = store.names[row];
+    // A keyframe is encoded against zero
+    auto it = keyframe ? prev.end() : prev.find(pid);
+    RecordedProcess base = it != prev.end() ? it->second : RecordedProcess{};
+    RecordedProcess cur{.nameRef = 0,
+                        .cpuCenti = toCenti(store.cpuUsed[row]),
+                        .memKB = store.memUsedKB[row],
+                        .ppid = store.ppids[row],
+                        .threads = store.threads[row]};
+    size_t mark = procBuffer.size();
+
+    cur.nameRef = nameRef(name);
+    putDelta(procBuffer, static_cast<int64_t>(pid) - prevPid);
+    if (it != prev.end() && cur.nameRef == base.nameRef && cur.nameRef != 1) {
+      putVarint(procBuffer, 0);
+    } else {
+      putVarint(procBuffer, cur.nameRef);
+      if (cur.nameRef == 1) {
+        size_t length = std::min(name.size(), maxNameLength);
+
+        putVarint(procBuffer, length);
+        procBuffer.append(name, 0, length);
+      }
+    }
+    procBuffer += static_cast<char>(store.states[row]);
+    putDelta(procBuffer, cur.cpuCenti - base.cpuCenti);
+    putDelta(procBuffer, cur.memKB - base.memKB);
+    putDelta(procBuffer, static_cast<int64_t>(cur.ppid) - base.ppid);
+    putDelta(procBuffer, cur.threads - base.threads);
+
+    // Leave room for the process count varint
+    if (slot.size() + procBuffer.size() + 10 > capacity) {
+      procBuffer.resize(mark);
+      break;
+    }
+    written.emplace_back(pid, cur);
+    prevPid = pid;
+  }
+
+  putVarint(slot, written.size());
+  slot += procBuffer;
+
+  char slotHeader[slotHeaderSize];
+  uint32_t length = slot.size();
+
+  std::memcpy(slotHeader, &length, sizeof(length));
+  std::memcpy(slotHeader + sizeof(length), &seq, sizeof(seq));
+
+  off_t offset = recordingHeaderSize + header.stringTableSize +
+                 (seq % header.slotCount) * header.slotSize;
+
+  if (pwrite(fd, slotHeader, slotHeaderSize, offset) != slotHeaderSize ||
+      pwrite(fd, slot.data(), slot.size(), offset + slotHeaderSize) !=
+          static_cast<ssize_t>(slot.size())) {
+    return;
+  }
+
+  // The new bases only count once the slot holding them is in the file;
+  // after a failed write the next slot is encoded against the old ones
+  if (keyframe) prev.clear();
+  for (const auto& [pid, cur] : written) prev[pid] = cur;
+
+  // Publish the slot only once its contents are in place
+  header.nextSeq = seq + 1;
+  pwrite(fd, &header, sizeof(header), 0);
+}
+
+RecordingReader::~RecordingReader() {
+  if (data) munmap(const_cast<char*>(data), size);
+}
+
+bool RecordingReader::open(const std::string& path, std::string& error) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    error = path + ": " + strerror(errno);
+    if (fd >= 0) ::close(fd);
+    return false;
+  }
+
+  size = st.st_size;
+  void* mapping =
+      size >= sizeof(RecordingHeader)
+          ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0)
+          : MAP_FAILED;
+  ::close(fd);
+
+  if (mapping == MAP_FAILED) {
+    error = path + ": not a recording";
+    size = 0;
+    return false;
+  }
+  data = static_cast<const char*>(mapping);
+  header = reinterpret_cast<const RecordingHeader*>(data);
+
+  if (std::memcmp(header->magic, recordingMagic, sizeof(recordingMagic)) !=
+          0 ||
+      header->version != recordingVersion || header->slotCount == 0 ||
+      recordingHeaderSize + header->stringTableSize +
+              header->slotCount * header->slotSize >
+          size) {
+    error = path + ": not a recording";
+    return false;
+  }
+
+  return true;
+}
+
+uint64_t RecordingReader::endSeq() const { return header->nextSeq; }
+
+uint64_t RecordingReader::firstSeq() const {
+  uint64_t end = endSeq();
+  uint64_t oldest = end > header->slotCount ? end - header->slotCount : 0;
+
+  // Decoding has to start on a keyframe that is still in the ring
+  uint64_t first = (oldest + recordingKeyframeInterval - 1) /
+                   recordingKeyframeInterval * recordingKeyframeInterval;
+
+  return std::min(first, end);
+}
+
+std::string_view RecordingReader::slotPayload(uint64_t seq) const {
+  const char* slot = data + recordingHeaderSize + header->stringTableSize +
+                     (seq % header->slotCount) * header->slotSize;
+  uint32_t length;
+  uint64_t slotSeq;
+
+  std::memcpy(&length, slot, sizeof(length));
+  std::memcpy(&slotSeq, slot + sizeof(length), sizeof(slotSeq));
+
+  // A slot overwritten since (or not yet written) does not match
+  if (slotSeq != seq || length > header->slotSize - slotHeaderSize) return {};
+
+  return std::string_view(slot + slotHeaderSize, length);
+}
+
+std::string_view RecordingReader::stringAt(uint32_t offset) const {
+  if (offset >= header->stringTableSize) return {};
+
+  const char* entry = data + recordingHeaderSize + offset;
+  size_t length = static_cast<uint8_t>(entry[0]);
+
+  if (offset + 1 + length > header->stringTableSize) return {};
+  return std::string_view(entry + 1, length);
+}
+
+std::chrono::system_clock::time_point RecordingReader::timestamp(
+    uint64_t seq) const {
+  std::string_view payload = slotPayload(seq);
+  uint64_t millis = 0;
+
+  getVarint(payload, millis);
+  return std::chrono::system_clock::time_point(
+      std::chrono::milliseconds(millis));
+}
+
+uint64_t RecordingReader::seek(
+    std::chrono::system_clock::time_point time) const {
+  uint64_t low = firstSeq();
+  uint64_t high = endSeq();
+
+  if (low == high) return low;
+
+  // Timestamps only grow, so binary search the ring
+  while (low < high) {
+    uint64_t mid = low + (high - low) / 2;
+
+    if (timestamp(mid) < time) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  return std::min(low, endSeq() - 1);
+}
+
+bool RecordingReader::read(uint64_t seq, Snapshot& snapshot) {
+  if (seq < firstSeq() || seq >= endSeq()) return false;
+
+  uint64_t start = seq - seq % recordingKeyframeInterval;
+
+  // Continue from the last decoded slot when it is on the way
+  if (decodedSeq != UINT64_MAX && decodedSeq >= start && decodedSeq < seq) {
+    start = decodedSeq + 1;
+  }
+
+  for (uint64_t i = start; i <= seq; i++) {
+    if (!decode(i, snapshot)) {
+      decodedSeq = UINT64_MAX;
+      return false;
+    }
+    decodedSeq = i;
+  }
+
+  return true;
+}
+
+bool RecordingReader::decode(uint64_t seq, Snapshot& snapshot) {
+  std::string_view in = slotPayload(seq);
+  uint64_t value, count;
+
+  if (in.empty()) return false;
+  if (isKeyframe(seq)) prev.clear();
+
+  if (!getVarint(in, value)) return false;
+  snapshot.timestamp =
+      std::chrono::system_clock::time_point(std::chrono::milliseconds(value));
+  getVarint(in, value);
+  snapshot.tick = value;
+  getVarint(in, value);
+  snapshot.missedDeadlines = value;
+  getVarint(in, value);
+  snapshot.processCount = value;
+  getVarint(in, value);
+  snapshot.cpu.totalUsage = fromCenti(value);
+  getVarint(in, count);
+  snapshot.cpu.perCoreUsage.clear();
+  for (uint64_t i = 0; i < count && getVarint(in, value); i++) {
+    snapshot.cpu.perCoreUsage.push_back(fromCenti(value));
+  }
+  // Only the totals are recorded, the breakdown is left at zero
+  snapshot.mem = MemoryUsage{};
+  getVarint(in, value);
+  snapshot.mem.totalKB = value;
+  getVarint(in, value);
+  snapshot.mem.usedKB = value;
+  getVarint(in, value);
+  snapshot.mem.availableKB = value;
+  getVarint(in, value);
+  snapshot.mem.usedPercent = fromCenti(value);
+
+  if (!getVarint(in, count)) return false;
+
+  int pid = 0;
+
+  snapshot.processes.resize(count);
+  for (uint64_t i = 0; i < count; i++) {
+    ProcessInfo& info = snapshot.processes[i];
+    int64_t pidDelta, cpuDelta, memDelta, ppidDelta, threadsDelta;
+    uint64_t ref;
+
+    if (!getDelta(in, pidDelta) || !getVarint(in, ref)) return false;
+    pid += pidDelta;
+
+    auto it = prev.find(pid);
+    RecordedProcess base = it != prev.end() ? it->second : RecordedProcess{};
+    RecordedProcess cur = base;
+
+    if (ref == 0) {
+      info.name.assign(stringAt(base.nameRef - 2));
+    } else if (ref == 1) {
+      uint64_t length;
+
+      if (!getVarint(in, length) || length > in.size()) return false;
+      info.name.assign(in.substr(0, length));
+      in.remove_prefix(length);
+      cur.nameRef = 1;
+    } else {
+      info.name.assign(stringAt(ref - 2));
+      cur.nameRef = ref;
+    }
+
+    if (in.empty()) return false;
+    info.state = static_cast<ProcessState>(in.front());
+    in.remove_prefix(1);
+
+    if (!getDelta(in, cpuDelta) || !getDelta(in, memDelta) ||
+        !getDelta(in, ppidDelta) || !getDelta(in, threadsDelta)) {
+      return false;
+    }
+    cur.cpuCenti += cpuDelta;
+    cur.memKB += memDelta;
+    cur.ppid += ppidDelta;
+    cur.threads += threadsDelta;
+    prev[pid] = cur;
+
+    info.pid = pid;
+    info.cpuUsed = fromCenti(cur.cpuCenti);
+    info.cpuEstimated = false;
+    info.memUsedKB = cur.memKB;
+    info.ppid = cur.ppid;
+    info.threads = cur.threads;
+    info.startTime = 0;
+    info.swapKB = 0;
+    info.pssKB = 0;
+    info.ussKB = 0;
+    info.readBytesPerSec = 0;
+    info.writeBytesPerSec = 0;
+  }
+
+  return true;
+}
@@ -0,0 +1,295 @@
+#include "Renderer.h"
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+
+static std::atomic<bool> resized{false};
+
+// Terminal state that the job-control handlers restore and re-apply: the
+// screen of the live Renderer and the modes of the live KeyReader, -1 if none
+static std::atomic<int> screenFd{-1};
+static std::atomic<int> keyFd{-1};
+static struct termios savedKeyMode;
+static struct termios rawKeyMode;
+
+// Write all of data, retrying after signals. Returns false if some of it
+// could not be written.
+static bool writeAll(int fd, std::string_view data) {
+  while (!data.empty()) {
+    ssize_t n = ::write(fd, data.data(), data.size());
+
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data.remove_prefix(n);
+  }
+  return true;
+}
+
+static constexpr std::string_view enterScreen = "\x1b[?1049h\x1b[?25l";
+static constexpr std::string_view leaveScreen = "\x1b[?25h\x1b[?1049l";
+
+static void onResize(int) { resized.store(true, std::memory_order_relaxed); }
+
+static void onContinue(int);
+
+// Ctrl-Z: give the shell its screen and terminal mode back, then stop for
+// real with the default action
+static void onStop(int) {
+  int savedErrno = errno;
+  int screen = screenFd.load(std::memory_order_relaxed);
+  int keys = keyFd.load(std::memory_order_relaxed);
+  struct sigaction action = {};
+  sigset_t mask;
+
+  if (keys >= 0) tcsetattr(keys, TCSANOW, &savedKeyMode);
+  if (screen >= 0) writeAll(screen, leaveScreen);
+
+  action.sa_handler = SIG_DFL;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGTSTP, &action, nullptr);
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGTSTP);
+  raise(SIGTSTP);
+  // The process stops as soon as SIGTSTP is unblocked, and resumes here
+  sigprocmask(SIG_UNBLOCK, &mask, nullptr);
+
+  action.sa_handler = onStop;
+  sigaction(SIGTSTP, &action, nullptr);
+  errno = savedErrno;
+}
+
+// After fg (or any stop): take the terminal again and repaint everything on
+// the next frame, as the screen holds whatever was drawn meanwhile
+static void onContinue(int) {
+  int savedErrno = errno;
+  int screen = screenFd.load(std::memory_order_relaxed);
+  int keys = keyFd.load(std::memory_order_relaxed);
+
+  if (keys >= 0) tcsetattr(keys, TCSANOW, &rawKeyMode);
+  if (screen >= 0) writeAll(screen, enterScreen);
+  resized.store(true, std::memory_order_relaxed);
+  errno = savedErrno;
+}
+
+Renderer::Renderer(int fd) : fd(fd) {
+  // Room for a typical frame, so that steady-state frames do not allocate
+  frame.reserve(64 * 1024);
+  prevFrame.reserve(64 * 1024);
+  output.reserve(64 * 1024);
+  updateSize();
+  // Alternate screen, hidden cursor
+  writeAll(fd, enterScreen);
+  screenFd.store(fd, std::memory_order_relaxed);
+}
+
+Renderer::~Renderer() {
+  screenFd.store(-1, std::memory_order_relaxed);
+  writeAll(fd, leaveScreen);
+}
+
+void Renderer::watchTerminal() {
+  struct sigaction action = {};
+
+  sigemptyset(&action.sa_mask);
+  action.sa_handler = onResize;
+  sigaction(SIGWINCH, &action, nullptr);
+  action.sa_handler = onStop;
+  sigaction(SIGTSTP, &action, nullptr);
+  action.sa_handler = onContinue;
+  sigaction(SIGCONT, &action, nullptr);
+}
+
+bool Renderer::resizePending() {
+  return resized.load(std::memory_order_relaxed);
+}
+
+void Renderer::updateSize() {
+  struct winsize size;
+
+  if (ioctl(fd, TIOCGWINSZ, &size) == 0 && size.ws_row > 0 &&
+      size.ws_col > 0) {
+    numRows = size.ws_row;
+    numCols = size.ws_col;
+  }
+}
+
+void Renderer::beginFrame() {
+  if (resized.exchange(false, std::memory_order_relaxed)) {
+    updateSize();
+    fullRedraw = true;
+  }
+
+  frame.swap(prevFrame);
+  lineEnds.swap(prevLineEnds);
+  frame.clear();
+  lineEnds.clear();
+  lineStart = 0;
+}
+
+std::string_view Renderer::line(const std::string& text,
+                                const std::vector<size_t>& ends,
+                                size_t i) const {
+  size_t begin = i == 0 ? 0 : ends[i - 1];
+
+  return std::string_view(text).substr(begin, ends[i] - begin);
+}
+
+// Append a cursor move to the first column of a 1-based row
+static void appendMove(std::string& output, size_t row) {
+  char move[32] = "\x1b[";
+  auto [end, ec] = std::to_chars(move + 2, move + sizeof(move) - 3, row);
+
+  *end++ = ';';
+  *end++ = '1';
+  *end++ = 'H';
+  output.append(move, end - move);
+}
+
+void Renderer::endFrame() {
+  size_t numLines = std::min(lineEnds.size(), static_cast<size_t>(numRows));
+
+  output.clear();
+  if (fullRedraw) output += "\x1b[2J";
+
+  for (size_t i = 0; i < numLines; i++) {
+    std::string_view current = line(frame, lineEnds, i);
+
+    if (!fullRedraw && i < prevLineEnds.size() &&
+        current == line(prevFrame, prevLineEnds, i)) {
+      continue;
+    }
+
+    // Move to the start of the row, write it and clear what is left of the
+    // previous contents
+    appendMove(output, i + 1);
+    output += current;
+    output += "\x1b[K";
+  }
+
+  // Blank the rows the previous frame used beyond this one
+  if (!fullRedraw && prevLineEnds.size() > numLines) {
+    appendMove(output, numLines + 1);
+    output += "\x1b[J";
+  }
+
+  // Keep only the lines that made it to the screen for the next diff. If
+  // the write fell short, what is on screen is unknown: repaint it all.
+  lineEnds.resize(numLines);
+  fullRedraw = !writeAll(fd, output);
+}
+
+Renderer& Renderer::text(std::string_view str) {
+  frame += str;
+  return *this;
+}
+
+Renderer& Renderer::column(std::string_view str, int width) {
+  size_t w = static_cast<size_t>(width);
+
+  if (str.size() >= w) {
+    frame.append(str.substr(0, w > 0 ? w - 1 : 0));
+    if (w > 0) frame += ' ';
+  } else {
+    frame.append(str);
+    frame.append(w - str.size(), ' ');
+  }
+  return *this;
+}
+
+Renderer& Renderer::column(unsigned long value, int width) {
+  char buffer[32];
+  auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+
+  return column(std::string_view(buffer, end - buffer), width);
+}
+
+Renderer& Renderer::column(double value, int precision, int width) {
+  char buffer[64];
+  auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value,
+                                 std::chars_format::fixed, precision);
+
+  if (ec != std::errc()) end = buffer;
+  return column(std::string_view(buffer, end - buffer), width);
+}
+
+Renderer& Renderer::number(unsigned long value) {
+  char buffer[32];
+  auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+
+  frame.append(buffer, end - buffer);
+  return *this;
+}
+
+Renderer& Renderer::number(double value, int precision) {
+  char buffer[64];
+  auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value,
+                                 std::chars_format::fixed, precision);
+
+  if (ec != std::errc()) end = buffer;
+  frame.append(buffer, end - buffer);
+  return *this;
+}
+
+void Renderer::endLine() {
+  // Clip to the window width
+  if (frame.size() - lineStart > static_cast<size_t>(numCols)) {
+    frame.resize(lineStart + numCols);
+  }
+  lineEnds.push_back(frame.size());
+  lineStart = frame.size();
+}
+
+KeyReader::KeyReader(int fd) : fd(fd) {
+  if (tcgetattr(fd, &savedMode) != 0) return;
+
+  struct termios mode = savedMode;
+
+  mode.c_lflag &= ~(ICANON | ECHO);
+  mode.c_cc[VMIN] = 1;
+  mode.c_cc[VTIME] = 0;
+  restore = tcsetattr(fd, TCSANOW, &mode) == 0;
+  if (restore) {
+    savedKeyMode = savedMode;
+    rawKeyMode = mode;
+    keyFd.store(fd, std::memory_order_relaxed);
+  }
+}
+
+KeyReader::~KeyReader() {
+  if (!restore) return;
+  keyFd.store(-1, std::memory_order_relaxed);
+  tcsetattr(fd, TCSANOW, &savedMode);
+}
+
+int KeyReader::readKey(std::chrono::milliseconds timeout) {
+  struct pollfd pfd = {.fd = fd, .events = POLLIN, .revents = 0};
+  char keys[8];
+
+  if (poll(&pfd, 1, static_cast<int>(timeout.count())) <= 0) return KeyNone;
+
+  ssize_t n = ::read(fd, keys, sizeof(keys));
+
+  if (n <= 0) return KeyNone;
+
+  // Arrow keys arrive as ESC [ A..D in a single read
+  if (n >= 3 && keys[0] == '\x1b' && keys[1] == '[') {
+    switch (keys[2]) {
+      case 'A':
+        return KeyUp;
+      case 'B':
+        return KeyDown;
+      case 'C':
+        return KeyRight;
+      case 'D':
+        return KeyLeft;
+    }
+  }
+  return static_cast<unsigned char>(keys[0]);
+}
@@ -0,0 +1,132 @@
+#include "SelfStats.h"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <bit>
+#include <vector>
+
+#include "ProcReader.h"
+
+const char* phaseName(Phase phase) {
+  switch (phase) {
+    case Phase::DirScan:
+      return "scan";
+    case Phase::Parse:
+      return "parse";
+    case Phase::CpuDelta:
+      return "delta";
+    case Phase::Sort:
+      return "sort";
+    case Phase::Tasks:
+      return "tasks";
+    case Phase::Pss:
+      return "pss";
+    case Phase::Cgroups:
+      return "cgroups";
+    case Phase::Render:
+      return "render";
+  }
+  return "?";
+}
+
+size_t LatencyHistogram::bucketFor(uint64_t ns) {
+  if (ns < subBuckets) return ns;
+
+  // The top bit selects the power of two, the next three the sub-bucket
+  unsigned msb = 63 - std::countl_zero(ns);
+  unsigned shift = msb - 3;
+  size_t bucket = (msb - 2) * subBuckets + ((ns >> shift) & (subBuckets - 1));
+
+  return bucket < bucketCount ? bucket : bucketCount - 1;
+}
+
+uint64_t LatencyHistogram::bucketValue(size_t bucket) {
+  if (bucket < subBuckets) return bucket;
+
+  unsigned msb = bucket / subBuckets + 2;
+  unsigned shift = msb - 3;
+  uint64_t low = (uint64_t{1} << msb) | ((bucket % subBuckets) << shift);
+
+  // Middle of the bucket
+  return low + (uint64_t{1} << shift) / 2;
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+  counts[bucketFor(ns)].fetch_add(1, std::memory_order_relaxed);
+  lastNs.store(ns, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::percentile(double fraction) const {
+  uint64_t total = 0;
+
+  for (const auto& count : counts) {
+    total += count.load(std::memory_order_relaxed);
+  }
+  if (total == 0) return 0;
+
+  uint64_t rank = static_cast<uint64_t>(fraction * (total - 1));
+  uint64_t seen = 0;
+
+  for (size_t i = 0; i < bucketCount; i++) {
+    seen += counts[i].load(std::memory_order_relaxed);
+    if (seen > rank) return bucketValue(i);
+  }
+  return bucketValue(bucketCount - 1);
+}
+
+SelfStats& SelfStats::instance() {
+  static SelfStats stats;
+  return stats;
+}
+
+static std::chrono::microseconds ownCpuTime() {
+  struct rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return {};
+
+  auto toMicros = [](const struct timeval& tv) {
+    return std::chrono::seconds(tv.tv_sec) +
+           std::chrono::microseconds(tv.tv_usec);
+  };
+
+  return toMicros(usage.ru_utime) + toMicros(usage.ru_stime);
+}
+
+static unsigned long ownRssKB() {
+  static std::vector<char> buffer;
+  std::string_view statm = readProcFile("/proc/self/statm", buffer);
+  unsigned long sizePages = 0, rssPages = 0;
+
+  nextUnsigned(statm, sizePages);
+  nextUnsigned(statm, rssPages);
+
+  return rssPages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+void SelfStats::sample(SelfSample& sample) {
+  unsigned long files = filesOpened.load(std::memory_order_relaxed);
+  unsigned long bytes = bytesRead.load(std::memory_order_relaxed);
+  auto now = std::chrono::steady_clock::now();
+  auto cpuTime = ownCpuTime();
+
+  sample.filesOpened = files - prevFilesOpened;
+  sample.bytesRead = bytes - prevBytesRead;
+  sample.cpuPercent =
+      prevTime.time_since_epoch().count() == 0 || now == prevTime
+          ? 0.0
+          : 100.0 * std::chrono::duration<double>(cpuTime - prevCpuTime) /
+                std::chrono::duration<double>(now - prevTime);
+  sample.rssKB = ownRssKB();
+
+  for (size_t i = 0; i < phaseCount; i++) {
+    sample.phases[i] = PhaseStats{.lastNs = histograms[i].last(),
+                                  .p50Ns = histograms[i].percentile(0.5),
+                                  .p99Ns = histograms[i].percentile(0.99)};
+  }
+
+  prevFilesOpened = files;
+  prevBytesRead = bytes;
+  prevTime = now;
+  prevCpuTime = cpuTime;
+}
@@ -0,0 +1,453 @@
+#include "SharedSnapshot.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+// Snapshots are encoded as raw native values: publisher and viewers are the
+// same binary on the same host, which the version in the header checks.
+template <typename T>
+static void put(std::string& out, const T& value) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void putString(std::string& out, std::string_view str) {
+  put(out, static_cast<uint32_t>(str.size()));
+  out.append(str);
+}
+
+template <typename T>
+static bool get(std::string_view& in, T& value) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  if (in.size() < sizeof(value)) return false;
+  std::memcpy(&value, in.data(), sizeof(value));
+  in.remove_prefix(sizeof(value));
+  return true;
+}
+
+static bool getString(std::string_view& in, std::string& str) {
+  uint32_t length;
+
+  if (!get(in, length) || in.size() < length) return false;
+  str.assign(in.data(), length);
+  in.remove_prefix(length);
+  return true;
+}
+
+// Row count followed by the rows that fit in capacity bytes
+template <typename Row, typename PutRow>
+static void putRows(std::string& out, const std::vector<Row>& rows,
+                    size_t capacity, PutRow putRow) {
+  size_t countOffset = out.size();
+  uint32_t count = 0;
+
+  put(out, count);
+  for (const Row& row : rows) {
+    size_t rowOffset = out.size();
+
+    putRow(row);
+    if (out.size() > capacity) {
+      out.resize(rowOffset);
+      break;
+    }
+    count++;
+  }
+  std::memcpy(out.data() + countOffset, &count, sizeof(count));
+}
+
+// Resize rows to a decoded count, refusing counts the input cannot hold
+template <typename Row>
+static bool getCount(std::string_view& in, std::vector<Row>& rows) {
+  uint32_t count;
+
+  if (!get(in, count) || count > in.size()) return false;
+  rows.resize(count);
+  return true;
+}
+
+static void encode(std::string& out, const Snapshot& snapshot,
+                   size_t capacity) {
+  out.clear();
+  put(out, snapshot.tick);
+  put(out, snapshot.timestamp.time_since_epoch().count());
+  put(out, snapshot.missedDeadlines);
+  put(out, snapshot.collectTime.count());
+  put(out, snapshot.cpu.totalUsage);
+  putRows(out, snapshot.cpu.perCoreUsage, capacity,
+          [&](double usage) { put(out, usage); });
+  put(out, snapshot.mem);
+  putRows(out, snapshot.disks, capacity, [&](const DiskUsage& disk) {
+    putString(out, disk.name);
+    put(out, disk.readsPerSec);
+    put(out, disk.writesPerSec);
+    put(out, disk.readBytesPerSec);
+    put(out, disk.writeBytesPerSec);
+    put(out, disk.utilization);
+  });
+  put(out, snapshot.processCount);
+  put(out, snapshot.events.tracked);
+  put(out, snapshot.events.started);
+  put(out, snapshot.events.exited);
+  put(out, snapshot.events.shortLived);
+  putRows(out, snapshot.events.shortLivedProcesses, capacity,
+          [&](const ShortLivedProcess& proc) {
+            put(out, proc.pid);
+            put(out, proc.ppid);
+            putString(out, proc.name);
+            put(out, proc.exitCode);
+            put(out, proc.lifetime.count());
+          });
+  put(out, snapshot.cgroupCount);
+  putRows(out, snapshot.cgroups, capacity, [&](const CgroupInfo& cgroup) {
+    putString(out, cgroup.path);
+    put(out, cgroup.cpuUsed);
+    put(out, cgroup.memCurrentKB);
+    put(out, cgroup.memAnonKB);
+    put(out, cgroup.memFileKB);
+    put(out, cgroup.readBytesPerSec);
+    put(out, cgroup.writeBytesPerSec);
+  });
+  putString(out, snapshot.expandedCgroup);
+  put(out, snapshot.self);
+  put(out, snapshot.tree);
+
+  // The potentially long lists go last so that only they get cut short
+  putRows(out, snapshot.processes, capacity, [&](const ProcessInfo& proc) {
+    put(out, proc.pid);
+    putString(out, proc.name);
+    put(out, proc.state);
+    put(out, proc.cpuUsed);
+    put(out, proc.cpuEstimated);
+    put(out, proc.memUsedKB);
+    put(out, proc.ppid);
+    put(out, proc.threads);
+    put(out, proc.startTime);
+    put(out, proc.swapKB);
+    put(out, proc.pssKB);
+    put(out, proc.ussKB);
+    put(out, proc.readBytesPerSec);
+    put(out, proc.writeBytesPerSec);
+    put(out, proc.depth);
+    put(out, proc.subtreeCpuUsed);
+    put(out, proc.subtreeMemKB);
+  });
+  putRows(out, snapshot.threads, capacity, [&](const ThreadInfo& thread) {
+    put(out, thread.tid);
+    put(out, thread.pid);
+    putString(out, thread.name);
+    put(out, thread.state);
+    put(out, thread.cpuUsed);
+  });
+}
+
+static bool decode(std::string_view in, Snapshot& snapshot) {
+  std::chrono::system_clock::rep timestamp;
+  std::chrono::nanoseconds::rep collectTime;
+
+  if (!get(in, snapshot.tick) || !get(in, timestamp) ||
+      !get(in, snapshot.missedDeadlines) || !get(in, collectTime) ||
+      !get(in, snapshot.cpu.totalUsage) ||
+      !getCount(in, snapshot.cpu.perCoreUsage)) {
+    return false;
+  }
+  snapshot.timestamp = std::chrono::system_clock::time_point(
+      std::chrono::system_clock::duration(timestamp));
+  snapshot.collectTime = std::chrono::nanoseconds(collectTime);
+  for (double& usage : snapshot.cpu.perCoreUsage) {
+    if (!get(in, usage)) return false;
+  }
+
+  if (!get(in, snapshot.mem) || !getCount(in, snapshot.disks)) return false;
+  for (DiskUsage& disk : snapshot.disks) {
+    if (!getString(in, disk.name) || !get(in, disk.readsPerSec) ||
+        !get(in, disk.writesPerSec) || !get(in, disk.readBytesPerSec) ||
+        !get(in, disk.writeBytesPerSec) || !get(in, disk.utilization)) {
+      return false;
+    }
+  }
+
+  ProcessEvents& events = snapshot.events;
+
+  if (!get(in, snapshot.processCount) || !get(in, events.tracked) ||
+      !get(in, events.started) || !get(in, events.exited) ||
+      !get(in, events.shortLived) ||
+      !getCount(in, events.shortLivedProcesses)) {
+    return false;
+  }
+  for (ShortLivedProcess& proc : events.shortLivedProcesses) {
+    std::chrono::microseconds::rep lifetime;
+
+    if (!get(in, proc.pid) || !get(in, proc.ppid) ||
+        !getString(in, proc.name) || !get(in, proc.exitCode) ||
+        !get(in, lifetime)) {
+      return false;
+    }
+    proc.lifetime = std::chrono::microseconds(lifetime);
+  }
+
+  if (!get(in, snapshot.cgroupCount) || !getCount(in, snapshot.cgroups)) {
+    return false;
+  }
+  for (CgroupInfo& cgroup : snapshot.cgroups) {
+    if (!getString(in, cgroup.path) || !get(in, cgroup.cpuUsed) ||
+        !get(in, cgroup.memCurrentKB) || !get(in, cgroup.memAnonKB) ||
+        !get(in, cgroup.memFileKB) || !get(in, cgroup.readBytesPerSec) ||
+        !get(in, cgroup.writeBytesPerSec)) {
+      return false;
+    }
+  }
+
+  if (!getString(in, snapshot.expandedCgroup) || !get(in, snapshot.self) ||
+      !get(in, snapshot.tree) || !getCount(in, snapshot.processes)) {
+    return false;
+  }
+  for (ProcessInfo& proc : snapshot.processes) {
+    if (!get(in, proc.pid) || !getString(in, proc.name) ||
+        !get(in, proc.state) || !get(in, proc.cpuUsed) ||
+        !get(in, proc.cpuEstimated) || !get(in, proc.memUsedKB) || !get(in, proc.ppid) ||
+        !get(in, proc.threads) || !get(in, proc.startTime) ||
+        !get(in, proc.swapKB) || !get(in, proc.pssKB) ||
+        !get(in, proc.ussKB) || !get(in, proc.readBytesPerSec) ||
+        !get(in, proc.writeBytesPerSec) || !get(in, proc.depth) ||
+        !get(in, proc.subtreeCpuUsed) || !get(in, proc.subtreeMemKB)) {
+      return false;
+    }
+  }
+
+  if (!getCount(in, snapshot.threads)) return false;
+  for (ThreadInfo& thread : snapshot.threads) {
+    if (!get(in, thread.tid) || !get(in, thread.pid) ||
+        !getString(in, thread.name) || !get(in, thread.state) ||
+        !get(in, thread.cpuUsed)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static std::string shmName(const std::string& name) {
+  return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+static size_t segmentSize(uint64_t slotSize) {
+  return sharedSnapshotHeaderSize +
+         2 * (sharedSnapshotSlotHeaderSize + slotSize);
+}
+
+static size_t slotOffset(uint64_t generation, uint64_t slotSize) {
+  return sharedSnapshotHeaderSize +
+         generation % 2 * (sharedSnapshotSlotHeaderSize + slotSize);
+}
+
+// Unlink the segment at path if it was left behind by a mini-top publisher
+// that has stopped or died. Returns false and sets error if something else
+// holds the name: a segment of another program, or a live publisher of any
+// version. Every version keeps the header fields up to closed in place.
+static bool removeStaleSegment(const std::string& path, std::string& error) {
+  int fd = ::shm_open(path.c_str(), O_RDONLY | O_CLOEXEC, 0);
+  struct stat st;
+
+  if (fd < 0 && errno == ENOENT) return true;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    error = path + ": " + strerror(errno);
+    if (fd >= 0) ::close(fd);
+    return false;
+  }
+
+  void* mapping = static_cast<size_t>(st.st_size) < sharedSnapshotHeaderSize
+                      ? MAP_FAILED
+                      : ::mmap(nullptr, sharedSnapshotHeaderSize, PROT_READ,
+                               MAP_SHARED, fd, 0);
+
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    error = path + ": exists and is not a mini-top snapshot segment";
+    return false;
+  }
+
+  auto* old = static_cast<const SharedSnapshotHeader*>(mapping);
+  bool ours = std::memcmp(old->magic, sharedSnapshotMagic,
+                          sizeof(old->magic)) == 0;
+  bool stale = ours && (old->closed.load(std::memory_order_acquire) ||
+                        (::kill(old->publisherPid, 0) != 0 && errno == ESRCH));
+  int pid = old->publisherPid;
+
+  ::munmap(mapping, sharedSnapshotHeaderSize);
+  if (!ours) {
+    error = path + ": exists and is not a mini-top snapshot segment";
+    return false;
+  }
+  if (!stale) {
+    error = path + ": already published by PID " + std::to_string(pid);
+    return false;
+  }
+
+  // Viewers still attached to the stale segment keep it until they detach
+  ::shm_unlink(path.c_str());
+  return true;
+}
+
+SnapshotPublisher::~SnapshotPublisher() {
+  if (!data) return;
+  header->closed.store(1, std::memory_order_release);
+  ::munmap(data, size);
+  ::shm_unlink(name.c_str());
+}
+
+bool SnapshotPublisher::open(const std::string& name, uint32_t flags,
+                             std::chrono::milliseconds interval,
+                             std::string& error) {
+  this->name = shmName(name);
+  if (!removeStaleSegment(this->name, error)) return false;
+
+  int fd = ::shm_open(this->name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+                      0644);
+
+  if (fd < 0) {
+    error = this->name + ": " + strerror(errno);
+    return false;
+  }
+
+  size = segmentSize(sharedSnapshotSlotSize);
+  if (ftruncate(fd, size) != 0) {
+    error = this->name + ": " + strerror(errno);
+    ::close(fd);
+    ::shm_unlink(this->name.c_str());
+    return false;
+  }
+
+  void* mapping =
+      ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    error = this->name + ": " + strerror(errno);
+    ::shm_unlink(this->name.c_str());
+    return false;
+  }
+
+  // The new segment is zero-filled, i.e. no generation and both slots even
+  data = static_cast<char*>(mapping);
+  header = new (data) SharedSnapshotHeader{};
+  std::memcpy(header->magic, sharedSnapshotMagic, sizeof(header->magic));
+  header->version = sharedSnapshotVersion;
+  header->flags = flags;
+  header->slotSize = sharedSnapshotSlotSize;
+  header->publisherPid = getpid();
+  header->intervalMs = interval.count();
+
+  encoded.reserve(sharedSnapshotSlotSize);
+  return true;
+}
+
+void SnapshotPublisher::write(const Snapshot& snapshot) {
+  if (!data) return;
+
+  encode(encoded, snapshot, sharedSnapshotSlotSize);
+  // Even the fixed part does not fit: leave the previous snapshot up
+  if (encoded.size() > sharedSnapshotSlotSize) return;
+
+  uint64_t generation =
+      header->generation.load(std::memory_order_relaxed) + 1;
+  char* slotData = data + slotOffset(generation, sharedSnapshotSlotSize);
+  auto* slot = reinterpret_cast<SharedSnapshotSlot*>(slotData);
+  uint64_t seq = slot->seq.load(std::memory_order_relaxed);
+
+  slot->seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot->size = encoded.size();
+  std::memcpy(slotData + sharedSnapshotSlotHeaderSize, encoded.data(),
+              encoded.size());
+  slot->seq.store(seq + 2, std::memory_order_release);
+  header->generation.store(generation, std::memory_order_release);
+}
+
+SnapshotViewer::~SnapshotViewer() { close(); }
+
+void SnapshotViewer::close() {
+  if (data) ::munmap(data, size);
+  data = nullptr;
+  header = nullptr;
+}
+
+bool SnapshotViewer::open(const std::string& name, std::string& error) {
+  std::string path = shmName(name);
+  int fd = ::shm_open(path.c_str(), O_RDONLY | O_CLOEXEC, 0);
+  struct stat st;
+
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    error = path + ": " + strerror(errno);
+    if (fd >= 0) ::close(fd);
+    return false;
+  }
+  if (static_cast<size_t>(st.st_size) < sharedSnapshotHeaderSize) {
+    error = path + ": not a mini-top snapshot segment";
+    ::close(fd);
+    return false;
+  }
+
+  void* mapping = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    error = path + ": " + strerror(errno);
+    return false;
+  }
+
+  auto* mapped = static_cast<const SharedSnapshotHeader*>(mapping);
+
+  if (std::memcmp(mapped->magic, sharedSnapshotMagic,
+                  sizeof(mapped->magic)) != 0 ||
+      mapped->version != sharedSnapshotVersion ||
+      static_cast<size_t>(st.st_size) < segmentSize(mapped->slotSize)) {
+    error = path + ": not a mini-top snapshot segment of this version";
+    ::munmap(mapping, st.st_size);
+    return false;
+  }
+
+  // The previous segment stays attached until the new one checks out
+  close();
+  data = static_cast<char*>(mapping);
+  size = st.st_size;
+  header = mapped;
+
+  return true;
+}
+
+bool SnapshotViewer::closed() const {
+  return header->closed.load(std::memory_order_acquire) ||
+         (::kill(header->publisherPid, 0) != 0 && errno == ESRCH);
+}
+
+bool SnapshotViewer::read(Snapshot& snapshot) {
+  // A retry means the publisher lapped the copy; a few more are plenty
+  for (int attempt = 0; attempt < 4; attempt++) {
+    uint64_t generation = header->generation.load(std::memory_order_acquire);
+
+    if (generation == 0) return false;
+
+    const char* slotData = data + slotOffset(generation, header->slotSize);
+    auto* slot = reinterpret_cast<const SharedSnapshotSlot*>(slotData);
+    uint64_t seq = slot->seq.load(std::memory_order_acquire);
+
+    if (seq & 1) continue;
+    copy.assign(slotData + sharedSnapshotSlotHeaderSize,
+                std::min<uint64_t>(slot->size, header->slotSize));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot->seq.load(std::memory_order_relaxed) != seq) continue;
+
+    return decode(copy, snapshot);
+  }
+
+  return false;
+}
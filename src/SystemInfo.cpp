@@ -2,41 +2,40 @@
 
 #include <unistd.h>
 
-#include <chrono>
-#include <fstream>
-#include <iostream>
-#include <thread>
-#include <unordered_map>
-
-CpuTimes SystemInfo::getCpuTimes(std::string& str) const {
-  unsigned long user, nice, system, idle, iowait, irq, softirq;
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+CpuTimes SystemInfo::getCpuTimes(std::string_view line) {
+  unsigned long user = 0, nice = 0, system = 0, idle = 0, iowait = 0, irq = 0,
+                softirq = 0;
   long totalTime, idleTime;
-  std::string label;
 
-  std::istringstream iss(str);
-  iss >> label >> user >> nice >> system >> idle >> iowait >> irq >> softirq;
+  nextToken(line);  // "cpu" / "cpuN" label
+  nextUnsigned(line, user) && nextUnsigned(line, nice) &&
+      nextUnsigned(line, system) && nextUnsigned(line, idle) &&
+      nextUnsigned(line, iowait) && nextUnsigned(line, irq) &&
+      nextUnsigned(line, softirq);
   totalTime = user + nice + system + idle + iowait + irq + softirq;
   idleTime = idle + iowait;
 
   return (CpuTimes){.total = totalTime, .idle = idleTime};
 }
 
-static int getLogicalCoreCount() {
-  long count = sysconf(_SC_NPROCESSORS_ONLN);
-
-  return (count > 0) ? static_cast<int>(count) : 1;
-}
+SystemInfo::SystemInfo(const std::string& procRoot,
+                       const std::string& sysRoot)
+    : statFile(procRoot + "/stat"),
+      meminfoFile(procRoot + "/meminfo"),
+      diskstatsFile(procRoot + "/diskstats"),
+      sysRoot(sysRoot) {}
 
 void SystemInfo::collectPerCoreSnapshots(
-    std::ifstream& statFile, unsigned numCores,
-    std::vector<CpuTimes>& snapshots) const {
-  std::string cpuStr;
-  CpuTimes snapshotTmp;
-
-  for (int i = 0; i < numCores; i++) {
-    getline(statFile, cpuStr);
-    snapshotTmp = getCpuTimes(cpuStr);
-    snapshots.push_back(snapshotTmp);
+    std::string_view& stat, std::vector<CpuTimes>& snapshots) const {
+  snapshots.clear();
+
+  // One "cpuN" line per online core follows the aggregate line
+  while (stat.starts_with("cpu")) {
+    snapshots.push_back(getCpuTimes(nextLine(stat)));
   }
 }
 
@@ -48,89 +47,183 @@ double calcUsage(double totalDelta, double idleDelta) {
   return ((totalDelta - idleDelta) / totalDelta) * 100.0;
 }
 
-CpuUsage SystemInfo::getCpuUsage() const {
-  // Sample the current CPU times
-  std::string cpuStr;
-  CpuTimes snapshot1, snapshot2;
-  std::vector<CpuTimes> perCoreSnapshot1;
-  std::vector<CpuTimes> perCoreSnapshot2;
-  int numCores = getLogicalCoreCount();
+CpuUsage SystemInfo::getCpuUsage() {
+  CpuTimes snapshot;
   CpuUsage stats;
 
-  // Read first snapshot from /proc/stat
-  std::ifstream statFile("/proc/stat");
-  getline(statFile, cpuStr);
-  snapshot1 = getCpuTimes(cpuStr);
-
-  collectPerCoreSnapshots(statFile, numCores, perCoreSnapshot1);
+  // Read current snapshot from /proc/stat
+  std::string_view stat = statFile.read();
+  snapshot = getCpuTimes(nextLine(stat));
 
-  // Sleep for a short period to get the second snapshot
-  std::this_thread::sleep_for(
-      std::chrono::milliseconds(this->snapshotsSleepMs));
+  collectPerCoreSnapshots(stat, this->curPerCore);
 
-  statFile.clear();
-  statFile.seekg(0);
+  size_t numCores = this->curPerCore.size();
 
-  // Read second snapshot from /proc/stat
-  getline(statFile, cpuStr);
-  snapshot2 = getCpuTimes(cpuStr);
+  // Cores may come online between ticks, start them from zero
+  this->prevPerCore.resize(numCores, CpuTimes{});
 
-  collectPerCoreSnapshots(statFile, numCores, perCoreSnapshot2);
-
-  statFile.close();
-
-  // Calculate CPU usage percentage
-  double totalDelta = snapshot2.total - snapshot1.total;
-  double idleDelta = snapshot2.idle - snapshot1.idle;
+  // Calculate CPU usage percentage against the previous tick
+  double totalDelta = snapshot.total - this->prevTotal.total;
+  double idleDelta = snapshot.idle - this->prevTotal.idle;
 
   stats.totalUsage = calcUsage(totalDelta, idleDelta);
+  stats.perCoreUsage.reserve(numCores);
 
-  for (int i = 0; i < numCores; i++) {
+  for (size_t i = 0; i < numCores; i++) {
     double perCoreTotalDelta =
-        perCoreSnapshot2[i].total - perCoreSnapshot1[i].total;
+        this->curPerCore[i].total - this->prevPerCore[i].total;
     double perCoreIdleDelta =
-        perCoreSnapshot2[i].idle - perCoreSnapshot1[i].idle;
+        this->curPerCore[i].idle - this->prevPerCore[i].idle;
     double perCorePercent =
         calcUsage(perCoreTotalDelta, perCoreIdleDelta);
 
     stats.perCoreUsage.push_back(perCorePercent);
   }
 
+  this->prevTotal = snapshot;
+  std::swap(this->prevPerCore, this->curPerCore);
+
   return stats;
 }
 
-static long
-getMemVal(std::ifstream& statFile)
-{
-  std::string memStr;
-  long val;
-  std::string label;
-  std::string units;
+// Lines of /proc/meminfo read into MemoryUsage, by label. Lines are matched
+// by label rather than position, which differs between kernel versions.
+static constexpr struct {
+  std::string_view label;
+  long MemoryUsage::*field;
+} meminfoFields[] = {
+    {"MemTotal:", &MemoryUsage::totalKB},
+    {"MemFree:", &MemoryUsage::freeKB},
+    {"MemAvailable:", &MemoryUsage::availableKB},
+    {"Buffers:", &MemoryUsage::buffersKB},
+    {"Cached:", &MemoryUsage::cachedKB},
+    {"SReclaimable:", &MemoryUsage::sReclaimableKB},
+    {"Shmem:", &MemoryUsage::shmemKB},
+    {"SwapTotal:", &MemoryUsage::swapTotalKB},
+    {"SwapFree:", &MemoryUsage::swapFreeKB},
+};
+
+MemoryUsage SystemInfo::getMemoryUsage() {
+  std::string_view meminfo = meminfoFile.read();
+  MemoryUsage result{};
+  size_t found = 0;
+  constexpr size_t wanted = std::size(meminfoFields);
+
+  while (!meminfo.empty() && found < wanted) {
+    std::string_view line = nextLine(meminfo);
+    std::string_view label = nextToken(line);
+
+    for (const auto& entry : meminfoFields) {
+      if (entry.label != label) continue;
+
+      unsigned long value = 0;
+
+      nextUnsigned(line, value);
+      result.*entry.field = static_cast<long>(value);
+      found++;
+      break;
+    }
+  }
 
-  getline(statFile, memStr);
+  // Same accounting as free(1) and htop: buffers and cache are free for the
+  // taking, except shared memory, which lives in the page cache but cannot
+  // be dropped
+  result.usedKB = result.totalKB - result.freeKB - result.buffersKB -
+                  result.cachedKB - result.sReclaimableKB + result.shmemKB;
+  result.usedKB = std::max(result.usedKB, 0L);
+  result.swapUsedKB = result.swapTotalKB - result.swapFreeKB;
+  result.usedPercent =
+      result.totalKB > 0
+          ? static_cast<double>(result.usedKB) / result.totalKB * 100.0
+          : 0.0;
 
-  std::istringstream iss(memStr);
+  return result;
+}
 
-  iss >> label >> val >> units;
+// Sectors in /proc/diskstats are always 512 bytes, whatever the device uses
+constexpr double diskSectorSize = 512;
 
-  return val;
-}
+// Only whole devices have an entry in /sys/block, and of those only the ones
+// backed by hardware have a device link. Names are looked up once, as
+// devices rarely come and go.
+bool SystemInfo::isPhysicalDisk(std::string_view name) {
+  auto it = physicalDisks.find(std::string(name));
 
-MemoryUsage SystemInfo::getMemoryUsage() const {
-  std::ifstream statFile("/proc/meminfo");
-  MemoryUsage result;
-  std::unordered_map<std::string, long> values;
+  if (it == physicalDisks.end()) {
+    std::string path = sysRoot + "/block/" + std::string(name) + "/device";
 
-  values["totalKB"] = getMemVal(statFile);
-  values["usedKB"] = getMemVal(statFile);
-  values["availableKB"] = getMemVal(statFile);
+    it = physicalDisks.emplace(name, ::access(path.c_str(), F_OK) == 0).first;
+  }
+  return it->second;
+}
 
-  result.totalKB = values["totalKB"];
-  // We use simplified logic here, we might need something like
-  // MemUsed = MemTotal - MemFree - Buffers - Cached - SReclaimable + Shmem
-  result.usedKB = result.totalKB - values["usedKB"];
-  result.availableKB = values["availableKB"];
-  result.usedPercent = (double)result.usedKB / (double)result.availableKB * 100;
+void SystemInfo::getDiskUsage(std::vector<DiskUsage>& disks) {
+  std::string_view diskstats = diskstatsFile.read();
+  auto now = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(now - prevDiskTime).count();
+  bool first = prevDiskTime == std::chrono::steady_clock::time_point();
+  size_t count = 0;
+
+  while (!diskstats.empty()) {
+    std::string_view line = nextLine(diskstats);
+    unsigned long value;
+
+    // major, minor, name, then the counters (see the kernel's
+    // Documentation/admin-guide/iostats.rst)
+    nextToken(line);
+    nextToken(line);
+
+    std::string_view name = nextToken(line);
+
+    if (name.empty() || !isPhysicalDisk(name)) continue;
+
+    if (curDisks.size() <= count) curDisks.emplace_back();
+
+    DiskCounters& cur = curDisks[count++];
+
+    cur.name.assign(name);
+    cur.reads = nextUnsigned(line, value) ? value : 0;
+    nextUnsigned(line, value);  // reads merged
+    cur.sectorsRead = nextUnsigned(line, value) ? value : 0;
+    nextUnsigned(line, value);  // ms reading
+    cur.writes = nextUnsigned(line, value) ? value : 0;
+    nextUnsigned(line, value);  // writes merged
+    cur.sectorsWritten = nextUnsigned(line, value) ? value : 0;
+    nextUnsigned(line, value);  // ms writing
+    nextUnsigned(line, value);  // requests in flight
+    cur.ioMs = nextUnsigned(line, value) ? value : 0;
+  }
+  curDisks.resize(count);
+
+  disks.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    const DiskCounters& cur = curDisks[i];
+    DiskUsage& usage = disks[i];
+    // Devices keep their order unless one was added or removed
+    const DiskCounters* prev =
+        i < prevDisks.size() && prevDisks[i].name == cur.name ? &prevDisks[i]
+                                                               : nullptr;
+
+    usage.name = cur.name;
+    // Counters only go backwards if the device was replaced
+    if (first || !prev || seconds <= 0 || cur.reads < prev->reads ||
+        cur.writes < prev->writes || cur.ioMs < prev->ioMs) {
+      usage.readsPerSec = usage.writesPerSec = 0.0;
+      usage.readBytesPerSec = usage.writeBytesPerSec = 0.0;
+      usage.utilization = 0.0;
+      continue;
+    }
+    usage.readsPerSec = (cur.reads - prev->reads) / seconds;
+    usage.writesPerSec = (cur.writes - prev->writes) / seconds;
+    usage.readBytesPerSec =
+        (cur.sectorsRead - prev->sectorsRead) * diskSectorSize / seconds;
+    usage.writeBytesPerSec =
+        (cur.sectorsWritten - prev->sectorsWritten) * diskSectorSize /
+        seconds;
+    usage.utilization =
+        std::min((cur.ioMs - prev->ioMs) / (seconds * 1000.0) * 100.0, 100.0);
+  }
 
-  return result;
+  std::swap(prevDisks, curDisks);
+  prevDiskTime = now;
 }
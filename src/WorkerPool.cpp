@@ -0,0 +1,86 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(unsigned numWorkers)
+    : numWorkers(std::max(numWorkers, 1u)),
+      queues(new ShardQueue[this->numWorkers]) {
+  for (unsigned i = 1; i < this->numWorkers; i++) {
+    threads.emplace_back(&WorkerPool::workerLoop, this, i);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  startCv.notify_all();
+  for (auto& thread : threads) thread.join();
+}
+
+void WorkerPool::run(size_t count, size_t shardSize, const ShardFn& fn) {
+  size_t numShards = (count + shardSize - 1) / shardSize;
+
+  // Hand out equal contiguous blocks of shards
+  for (unsigned i = 0; i < numWorkers; i++) {
+    queues[i].next.store(numShards * i / numWorkers,
+                         std::memory_order_relaxed);
+    queues[i].end = numShards * (i + 1) / numWorkers;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->shardFn = &fn;
+    this->itemCount = count;
+    this->shardSize = shardSize;
+    this->pending = numWorkers - 1;
+    this->generation++;
+  }
+  startCv.notify_all();
+
+  processShards(0);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  doneCv.wait(lock, [this] { return pending == 0; });
+  shardFn = nullptr;
+}
+
+void WorkerPool::workerLoop(unsigned worker) {
+  unsigned long seenGeneration = 0;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      startCv.wait(lock,
+                   [&] { return stopping || generation != seenGeneration; });
+      if (stopping) return;
+      seenGeneration = generation;
+    }
+
+    processShards(worker);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--pending == 0) doneCv.notify_one();
+    }
+  }
+}
+
+void WorkerPool::processShards(unsigned worker) {
+  // Drain our own block first, then walk the other workers' blocks
+  for (unsigned i = 0; i < numWorkers; i++) {
+    ShardQueue& queue = queues[(worker + i) % numWorkers];
+
+    while (true) {
+      size_t shard = queue.next.fetch_add(1, std::memory_order_relaxed);
+
+      if (shard >= queue.end) break;
+
+      size_t begin = shard * shardSize;
+      size_t end = std::min(begin + shardSize, itemCount);
+
+      (*shardFn)(worker, begin, end);
+    }
+  }
+}
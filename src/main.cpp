@@ -1,17 +1,223 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <ctime>
 #include <cxxopts.hpp>
-#include <future>
 #include <iostream>
+#include <optional>
 
+#include "BatchWriter.h"
+#include "Collector.h"
+#include "Display.h"
 #include "ProcessTable.h"
+#include "Recording.h"
+#include "Renderer.h"
+#include "SharedSnapshot.h"
 #include "SystemInfo.h"
 
-int main(int argc, char *argv[]) {
-  CpuUsage cpuUsage;
-  MemoryUsage memUsage;
-  std::vector<ProcessInfo> processes;
-  // Percentage of overall refresh timeout to use in CPU/RAM threads
-  constexpr unsigned thrSleepPercent = 10;
+static std::atomic<bool> quit{false};
+
+static void onQuit(int) { quit.store(true, std::memory_order_relaxed); }
+
+// Leave the main loop on Ctrl+C / SIGTERM so that the terminal is restored
+static void installQuitHandler() {
+  struct sigaction action = {};
+
+  action.sa_handler = onQuit;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+}
+
+// Format a wall-clock time as local "YYYY-MM-DD HH:MM:SS.mmm"
+static std::string formatTime(std::chrono::system_clock::time_point time) {
+  time_t seconds = std::chrono::system_clock::to_time_t(time);
+  auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    time.time_since_epoch())
+                    .count() %
+                1000;
+  struct tm local;
+  char text[64];
+
+  localtime_r(&seconds, &local);
+  size_t len = strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &local);
+  snprintf(text + len, sizeof(text) - len, ".%03lld",
+           static_cast<long long>(millis));
+
+  return text;
+}
+
+// Step through a recording in the regular display. Space pauses, n / right
+// and p / left step one tick, q quits.
+static int runReplay(const std::string& path, const std::string& seek,
+                     unsigned intervalMs, DisplayOptions displayOptions) {
+  RecordingReader reader;
+  std::string error;
+
+  if (!reader.open(path, error)) {
+    std::cerr << "Cannot replay: " << error << "\n";
+    return 1;
+  }
+  if (reader.firstSeq() == reader.endSeq()) {
+    std::cerr << "Cannot replay: " << path << " is empty\n";
+    return 1;
+  }
+
+  uint64_t seq = reader.firstSeq();
+
+  if (!seek.empty()) {
+    bool relative = seek[0] == '+';
+    const char* begin = seek.data() + (relative ? 1 : 0);
+    const char* end = seek.data() + seek.size();
+    long seconds;
+    auto [ptr, ec] = std::from_chars(begin, end, seconds);
+
+    if (ec != std::errc() || ptr != end) {
+      std::cerr << "Invalid --seek value: " << seek
+                << " (expected a Unix time or +SECONDS)\n";
+      return 1;
+    }
+
+    std::chrono::system_clock::time_point target =
+        relative ? reader.timestamp(seq) + std::chrono::seconds(seconds)
+                 : std::chrono::system_clock::time_point(
+                       std::chrono::seconds(seconds));
+
+    seq = reader.seek(target);
+  }
+
+  Renderer renderer(STDOUT_FILENO);
+  KeyReader keys(STDIN_FILENO);
+  Snapshot snapshot;
+  bool paused = false;
+  bool redraw = true;
+
+  Renderer::watchTerminal();
+
+  while (!quit.load(std::memory_order_relaxed)) {
+    if (redraw || Renderer::resizePending()) {
+      if (!reader.read(seq, snapshot)) break;
+      displayOptions.statusLine =
+          "Replay " + formatTime(snapshot.timestamp) + "  [" +
+          std::to_string(seq - reader.firstSeq() + 1) + "/" +
+          std::to_string(reader.endSeq() - reader.firstSeq()) + "]" +
+          (paused ? "  paused" : "") +
+          "  (space: pause, n/p: step, q: quit)";
+      drawSnapshot(renderer, snapshot, displayOptions);
+      redraw = false;
+    }
+
+    // Play back at the recorded pace
+    auto wait = std::chrono::milliseconds(intervalMs);
+
+    if (seq + 1 < reader.endSeq()) {
+      wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+          reader.timestamp(seq + 1) - reader.timestamp(seq));
+      wait = std::clamp(wait, std::chrono::milliseconds(0),
+                        std::chrono::milliseconds(5000));
+    }
 
+    int key = keys.readKey(paused ? std::chrono::milliseconds(50) : wait);
+
+    switch (key) {
+      case KeyReader::KeyNone:
+        if (!paused && seq + 1 < reader.endSeq()) {
+          seq++;
+          redraw = true;
+        }
+        break;
+      case ' ':
+        paused = !paused;
+        redraw = true;
+        break;
+      case 'n':
+      case KeyReader::KeyRight:
+        if (seq + 1 < reader.endSeq()) seq++;
+        redraw = true;
+        break;
+      case 'p':
+      case KeyReader::KeyLeft:
+        if (seq > reader.firstSeq()) seq--;
+        redraw = true;
+        break;
+      case 'q':
+        return 0;
+    }
+  }
+
+  return 0;
+}
+
+// Display the snapshots of another instance running with --publish, without
+// touching /proc. Re-attaches when a new publisher replaces a stopped one.
+static int runViewer(const std::string& name, DisplayOptions displayOptions) {
+  SnapshotViewer viewer;
+  std::string error;
+
+  if (!viewer.open(name, error)) {
+    std::cerr << "Cannot attach: " << error << "\n";
+    return 1;
+  }
+
+  Renderer renderer(STDOUT_FILENO);
+  KeyReader keys(STDIN_FILENO);
+  Snapshot snapshot;
+  uint64_t shown = 0;
+  bool shownClosed = false;
+  auto lastAttach = std::chrono::steady_clock::now();
+
+  Renderer::watchTerminal();
+
+  while (!quit.load(std::memory_order_relaxed)) {
+    bool closed = viewer.closed();
+    auto now = std::chrono::steady_clock::now();
+
+    if (closed && now - lastAttach >= std::chrono::seconds(1)) {
+      lastAttach = now;
+      if (viewer.open(name, error)) {
+        closed = viewer.closed();
+        shown = 0;
+      }
+    }
+
+    // The columns follow what the publisher collects
+    uint32_t flags = viewer.flags();
+
+    displayOptions.showSwap = flags & SnapshotPublisher::ShowSwap;
+    displayOptions.showPss = flags & SnapshotPublisher::ShowPss;
+    displayOptions.showIo = flags & SnapshotPublisher::ShowIo;
+    displayOptions.showCgroups = flags & SnapshotPublisher::ShowCgroups;
+    displayOptions.showSelfStats = flags & SnapshotPublisher::ShowSelfStats;
+
+    uint64_t generation = viewer.generation();
+
+    if ((generation != shown || closed != shownClosed ||
+         Renderer::resizePending()) &&
+        viewer.read(snapshot)) {
+      displayOptions.statusLine =
+          "Viewing " + name + " (PID " +
+          std::to_string(viewer.publisherPid()) + ")" +
+          (closed ? "  publisher stopped" : "") + "  (q: quit)";
+      displayOptions.selectedCgroup = snapshot.expandedCgroup;
+      drawSnapshot(renderer, snapshot, displayOptions);
+      shown = generation;
+      shownClosed = closed;
+    }
+
+    // Polling the generation is one load from the shared page
+    if (keys.readKey(std::chrono::milliseconds(20)) == 'q') break;
+  }
+
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
   cxxopts::Options options("mini-top", "Top-like system monitor");
 
   options.add_options()
@@ -19,6 +225,58 @@ int main(int argc, char *argv[]) {
        cxxopts::value<unsigned>()->default_value("200"))
       ("n,nproc", "Number of processes to display",
        cxxopts::value<unsigned>()->default_value("10"))
+      ("o,sort", "Sort processes by cpu, mem, pid or io",
+       cxxopts::value<std::string>()->default_value("cpu"))
+      ("s,swap", "Show per-process swap usage (reads /proc/<pid>/status)")
+      ("full-names", "Show untruncated process names (reads /proc/<pid>/comm)")
+      ("io", "Show per-process I/O rates (reads /proc/<pid>/io) and "
+       "per-disk activity")
+      ("pss", "Show per-process PSS and USS (reads /proc/<pid>/smaps_rollup)")
+      ("pss-budget", "Time per tick spent reading PSS, in milliseconds",
+       cxxopts::value<unsigned>()->default_value("5"))
+      ("H,threads", "Show the threads of the displayed processes "
+       "(toggle with H)")
+      ("t,tree", "Show processes as a tree with per-subtree CPU and memory "
+       "(toggle with t)")
+      ("adaptive", "Re-read idle processes at exponentially longer intervals")
+      ("read-budget", "Most /proc/<pid> files read per tick with --adaptive "
+       "(0: no limit)",
+       cxxopts::value<unsigned>()->default_value("0"))
+      ("scan-threads", "Number of threads reading /proc/<pid> entries",
+       cxxopts::value<unsigned>()->default_value("1"))
+      ("cgroups", "Show usage per cgroup (v2) instead of per process "
+       "(Enter lists the selected cgroup's processes)")
+      ("cgroup", "Start with the processes of this cgroup listed, e.g. "
+       "/system.slice",
+       cxxopts::value<std::string>())
+      ("cgroup-root", "Where the cgroup v2 hierarchy is mounted",
+       cxxopts::value<std::string>()->default_value("/sys/fs/cgroup"))
+      ("proc-events", "Track processes with the kernel proc connector "
+       "instead of listing /proc every tick (needs CAP_NET_ADMIN)")
+      ("proc-root", "Where procfs is mounted",
+       cxxopts::value<std::string>()->default_value("/proc"))
+      ("b,batch", "Write every tick to the output instead of the screen")
+      ("f,format", "Batch output format: csv or jsonl",
+       cxxopts::value<std::string>()->default_value("csv"))
+      ("output", "Batch output file (default: stdout)",
+       cxxopts::value<std::string>())
+      ("c,count", "Exit after this many ticks (0: run until interrupted)",
+       cxxopts::value<unsigned long>()->default_value("0"))
+      ("record", "Record every tick (all processes) into a ring file",
+       cxxopts::value<std::string>())
+      ("record-ticks", "Number of ticks the recording ring holds",
+       cxxopts::value<unsigned long>()->default_value("3600"))
+      ("replay", "Play back a recording instead of sampling the system",
+       cxxopts::value<std::string>())
+      ("seek", "Start the replay at this Unix time, or +SECONDS into it",
+       cxxopts::value<std::string>())
+      ("publish", "Sample without a screen and publish every tick in this "
+       "shared-memory segment for --attach viewers",
+       cxxopts::value<std::string>())
+      ("attach", "Display the ticks published in this shared-memory segment "
+       "instead of sampling the system",
+       cxxopts::value<std::string>())
+      ("self-stats", "Show mini-top's own overhead per tick")
       ("h,help", "Print help");
 
   auto result = options.parse(argc, argv);
@@ -30,51 +288,284 @@ int main(int argc, char *argv[]) {
 
   unsigned intervalMs = result["interval"].as<unsigned>();
   unsigned procNum = result["nproc"].as<unsigned>();
+  unsigned scanThreads = result["scan-threads"].as<unsigned>();
+  std::string sortName = result["sort"].as<std::string>();
+  SortKey sortKey;
+  bool showSwap = result.count("swap");
+  unsigned procFields = 0;
+
+  if (sortName == "cpu") {
+    sortKey = SortKey::Cpu;
+  } else if (sortName == "mem") {
+    sortKey = SortKey::Memory;
+  } else if (sortName == "pid") {
+    sortKey = SortKey::Pid;
+  } else if (sortName == "io") {
+    sortKey = SortKey::Io;
+  } else {
+    std::cerr << "Unknown sort key: " << sortName << "\n";
+    return 1;
+  }
 
-  ProcessTable procTable = ProcessTable(intervalMs / thrSleepPercent);
-  SystemInfo sysInfo = SystemInfo(intervalMs / thrSleepPercent);
+  if (showSwap) procFields |= ProcessTable::FieldSwap;
+  // Sorting by I/O shows the I/O columns too
+  if (result.count("io") || sortKey == SortKey::Io) {
+    procFields |= ProcessTable::FieldIo;
+  }
+  if (result.count("full-names")) procFields |= ProcessTable::FieldFullName;
+
+  DisplayOptions displayOptions;
+
+  displayOptions.showSwap = showSwap;
+  displayOptions.showPss = result.count("pss");
+  displayOptions.showIo = procFields & ProcessTable::FieldIo;
+  displayOptions.showCgroups =
+      result.count("cgroups") || result.count("cgroup");
+  displayOptions.maxProcesses = procNum;
+  displayOptions.showSelfStats = result.count("self-stats");
+  installQuitHandler();
+
+  if (result.count("replay")) {
+    std::string seek =
+        result.count("seek") ? result["seek"].as<std::string>() : "";
+
+    return runReplay(result["replay"].as<std::string>(), seek, intervalMs,
+                     displayOptions);
+  }
+  if (result.count("attach")) {
+    return runViewer(result["attach"].as<std::string>(), displayOptions);
+  }
+
+  std::optional<RecordingWriter> recorder;
+
+  if (result.count("record")) {
+    std::string error;
+
+    recorder.emplace();
+    if (!recorder->open(result["record"].as<std::string>(),
+                        result["record-ticks"].as<unsigned long>(), error)) {
+      std::cerr << "Cannot record: " << error << "\n";
+      return 1;
+    }
+  }
+
+  std::string procRoot = result["proc-root"].as<std::string>();
+  ProcessTable procTable(procFields, scanThreads, procRoot);
+
+  if (result.count("adaptive")) {
+    procTable.enableAdaptiveSampling(result["read-budget"].as<unsigned>());
+  }
+  if (displayOptions.showPss) {
+    unsigned pssBudget = result["pss-budget"].as<unsigned>();
+
+    // No budget would leave the PSS columns at zero
+    if (pssBudget == 0) {
+      std::cerr << "--pss-budget must be at least 1 ms\n";
+      return 1;
+    }
+    procTable.enablePss(std::chrono::milliseconds(pssBudget));
+  }
+
+  if (result.count("proc-events")) {
+    std::string error;
+
+    // The connector reports the PIDs of the running kernel, which only match
+    // the real /proc
+    if (procRoot != "/proc") {
+      std::cerr << "--proc-events ignored with --proc-root\n";
+    } else if (!procTable.enableProcEvents(error)) {
+      std::cerr << "Listing /proc instead of using events: " << error << "\n";
+    }
+  }
+
+  SystemInfo sysInfo(procRoot);
+  Collector collector(sysInfo, procTable,
+                      std::chrono::milliseconds(intervalMs), procNum, sortKey);
+
+  // Every tick is recorded, with the whole process table rather than just
+  // the displayed rows. The consumer runs between updates of the table.
+  if (recorder) {
+    collector.addConsumer([&](const Snapshot& snapshot) {
+      recorder->write(snapshot, procTable.processStore(), sortKey);
+    });
+  }
+  unsigned long maxTicks = result["count"].as<unsigned long>();
+  std::string cgroupRoot = result["cgroup-root"].as<std::string>();
+
+  // Hybrid setups mount the v2 hierarchy next to the v1 controllers
+  if (access((cgroupRoot + "/cgroup.controllers").c_str(), F_OK) != 0 &&
+      access((cgroupRoot + "/unified/cgroup.controllers").c_str(), F_OK) == 0) {
+    cgroupRoot += "/unified";
+  }
+
+  CgroupTable cgroupTable(cgroupRoot);
 
-  while (1) {
-    auto memFuture =
-        std::async(std::launch::async, [info = sysInfo]() { return info.getMemoryUsage(); });
+  if (displayOptions.showCgroups) {
+    collector.enableCgroups(cgroupTable);
+    if (result.count("cgroup")) {
+      displayOptions.selectedCgroup =
+          CgroupTable::normalizePath(result["cgroup"].as<std::string>());
+      collector.expandCgroup(displayOptions.selectedCgroup);
+    }
+  }
+
+  bool showThreads = result.count("threads");
+  bool showTree = result.count("tree");
+
+  if (displayOptions.showSelfStats) collector.enableSelfStats();
+  if (displayOptions.showIo) collector.enableDiskStats();
+  // Only the processes that are output get expanded, even when recording
+  if (showThreads) collector.expandThreads(procNum);
+  collector.enableTree(showTree);
+  unsigned long lastTick = 0;
+  std::optional<SnapshotPublisher> publisher;
+
+  if (result.count("publish")) {
+    uint32_t flags = 0;
+    std::string error;
+
+    if (displayOptions.showSwap) flags |= SnapshotPublisher::ShowSwap;
+    if (displayOptions.showPss) flags |= SnapshotPublisher::ShowPss;
+    if (displayOptions.showIo) flags |= SnapshotPublisher::ShowIo;
+    if (displayOptions.showCgroups) flags |= SnapshotPublisher::ShowCgroups;
+    if (displayOptions.showSelfStats) {
+      flags |= SnapshotPublisher::ShowSelfStats;
+    }
 
-    auto cpuFuture =
-        std::async(std::launch::async, [info = sysInfo]() { return info.getCpuUsage(); });
+    publisher.emplace();
+    if (!publisher->open(result["publish"].as<std::string>(), flags,
+                         std::chrono::milliseconds(intervalMs), error)) {
+      std::cerr << "Cannot publish: " << error << "\n";
+      return 1;
+    }
+  }
 
-    auto procFuture = std::async(std::launch::async,
-                                 [table = procTable]() { return table.getProcesses(); });
+  // Publishing runs without a screen, with batch output only if asked for
+  if (result.count("batch") || publisher) {
+    std::optional<BatchWriter> writer;
+    std::string formatName = result["format"].as<std::string>();
+    BatchFormat format;
+    int outFd = STDOUT_FILENO;
+
+    if (formatName == "csv") {
+      format = BatchFormat::Csv;
+    } else if (formatName == "jsonl") {
+      format = BatchFormat::JsonLines;
+    } else {
+      std::cerr << "Unknown batch format: " << formatName << "\n";
+      return 1;
+    }
 
-    cpuUsage = cpuFuture.get();
-    memUsage = memFuture.get();
-    processes = procFuture.get();
+    if (result.count("batch") && result.count("output")) {
+      std::string path = result["output"].as<std::string>();
 
-    std::system("clear");
+      outFd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                   0644);
+      if (outFd < 0) {
+        std::cerr << "Cannot open " << path << ": " << strerror(errno)
+                  << "\n";
+        return 1;
+      }
+    }
+
+    if (result.count("batch")) {
+      writer.emplace(outFd, format, procNum, displayOptions.showSelfStats,
+                     displayOptions.showPss, displayOptions.showIo, showTree);
+    }
 
-    std::cout << "CPU load:\n";
+    // Output is published and written on the sampling thread so that no
+    // tick is dropped; --count counts the ticks actually written
+    std::atomic<unsigned long> written{0};
 
-    std::cout << "Total usage = " << cpuUsage.totalUsage << "%\n";
-    for (int i = 0; i < cpuUsage.perCoreUsage.size(); i++) {
-      std::cout << "Core " << i << " usage = " << cpuUsage.perCoreUsage[i]
-                << "%\n";
+    collector.addConsumer([&](const Snapshot& snapshot) {
+      if (maxTicks != 0 &&
+          written.load(std::memory_order_relaxed) >= maxTicks) {
+        return;
+      }
+      if (publisher) publisher->write(snapshot);
+      if (writer) writer->write(snapshot);
+      written.fetch_add(1, std::memory_order_relaxed);
+    });
+    collector.start();
+    while (!quit.load(std::memory_order_relaxed) &&
+           (maxTicks == 0 ||
+            written.load(std::memory_order_relaxed) < maxTicks)) {
+      lastTick =
+          collector.waitForTick(lastTick, std::chrono::milliseconds(50));
     }
+    collector.stop();
 
-    std::cout << "Total RAM: " << memUsage.totalKB << " kB\n";
-    std::cout << "Used RAM: " << memUsage.usedKB << " kB\n";
-    std::cout << "Available RAM: " << memUsage.availableKB << " kB\n";
-    std::cout << "RAM usage: " << memUsage.usedPercent << "%\n";
+    if (outFd != STDOUT_FILENO) close(outFd);
+    return 0;
+  }
+
+  Renderer renderer(STDOUT_FILENO);
+  KeyReader keys(STDIN_FILENO);
+
+  Renderer::watchTerminal();
+  collector.start();
+
+  while (!quit.load(std::memory_order_relaxed) &&
+         (maxTicks == 0 || lastTick < maxTicks)) {
+    // Collection runs on its own schedule; redraw whenever a tick lands. The
+    // timeout keeps keys, resizes and Ctrl+C responsive between ticks.
+    unsigned long tick =
+        collector.waitForTick(lastTick, std::chrono::milliseconds(50));
+
+    int key = keys.readKey(std::chrono::milliseconds(0));
+
+    if (displayOptions.showCgroups && key != KeyReader::KeyNone) {
+      // Move the selection through the cgroups of the last frame; Enter
+      // lists the selected cgroup's processes or hides them again
+      const Snapshot& current = collector.latest();
+      const std::vector<CgroupInfo>& cgroups = current.cgroups;
+      std::string& selected = displayOptions.selectedCgroup;
+      size_t count = std::min<size_t>(cgroups.size(), procNum);
+      size_t index = 0;
 
-    std::cout << "Active processes: " << processes.size() << "\n\n";
-    procTable.printTableHeader();
-    unsigned processesToShow =
-        processes.size() < procNum ? processes.size() : procNum;
-    for (int i = 0; i < processesToShow; i++) {
-      std::cout << processes[i] << "\n";
+      while (index < count && cgroups[index].path != selected) index++;
+
+      bool redraw = true;
+
+      if (key == KeyReader::KeyDown && count > 0) {
+        selected = cgroups[index < count ? std::min(index + 1, count - 1) : 0]
+                       .path;
+      } else if (key == KeyReader::KeyUp && count > 0) {
+        selected = cgroups[index < count && index > 0 ? index - 1 : 0].path;
+      } else if ((key == '\n' || key == '\r') && !selected.empty()) {
+        collector.expandCgroup(current.expandedCgroup == selected ? ""
+                                                                  : selected);
+      } else {
+        redraw = false;
+      }
+      if (redraw) drawSnapshot(renderer, current, displayOptions);
+    }
+
+    switch (key) {
+      case 'H':
+        // Takes effect from the next tick
+        showThreads = !showThreads;
+        collector.expandThreads(showThreads ? procNum : 0);
+        break;
+      case 't':
+        showTree = !showTree;
+        collector.enableTree(showTree);
+        break;
+      case 'q':
+        quit.store(true, std::memory_order_relaxed);
+        continue;
     }
 
-    // Or use std::this_thread::sleep_until instead
-    std::this_thread::sleep_for(
-        std::chrono::milliseconds(intervalMs - (intervalMs / thrSleepPercent)));
+    if (tick == lastTick && !Renderer::resizePending()) continue;
+    if (tick == 0) continue;
+
+    const Snapshot& snapshot = collector.latest();
+
+    lastTick = tick;
+    drawSnapshot(renderer, snapshot, displayOptions);
   }
 
+  collector.stop();
+
   return 0;
 }